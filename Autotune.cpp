@@ -0,0 +1,490 @@
+// Autotune
+// Called from the main loop 20 times per second
+// Measures the oven's thermal model in one run, instead of learning it by aborting reflows.
+//
+// The oven is modelled as first order plus dead time: a gain K (how many degrees above
+// ambient 1% of full power holds the oven at), a time constant T and a dead time L.
+// "Full power" is every heating element on (the boost element at BOOST_MAX_DUTY).
+// 1. Step: full power from a cool oven.  The steepest rise over 10 seconds gives K / T, and
+//    where that tangent crosses the starting temp gives L.
+// 2. Relay (Astrom-Hagglund): full power below the test temp less AUTOTUNE_HYSTERESIS, off
+//    above it plus AUTOTUNE_HYSTERESIS.  Once it is oscillating steadily, the average
+//    power it took to hold the test temp gives K.  The period and amplitude (the ultimate
+//    period and gain) are shown too.
+// The model is saved in Settings::AUTOTUNE_GAIN etc, and is forgotten if the outputs are
+// reconfigured.  It gives the bake PID gains (unless they have been set) and the starting
+// reflow duty cycles (the next reflow starts over with them, see Reflow.cpp).
+
+#include <Arduino.h>
+#include "ReflowWizard.h"
+#include "Coroutine.h"
+#include "TelemetryFormat.h"
+
+#define MILLIS_TO_SECONDS ((long) 1000)
+
+#define AUTOTUNE_HYSTERESIS   1 // Degrees either side of the test temp
+#define AUTOTUNE_CYCLES       3 // Relay cycles to measure, after one to settle
+#define AUTOTUNE_STEP_LIMIT  30 // Give up if the step takes longer than this (minutes)
+#define AUTOTUNE_RELAY_LIMIT 60 // Give up if the relay test takes longer than this (minutes)
+#define SLOPE_SECONDS        10 // The step's slope is measured over this many seconds
+#define OVEN_AMBIENT         25 // Assumed room temp (C) when using the model
+
+namespace {
+
+#define PHASE_INIT   0 // Check the oven is cool
+#define PHASE_STEP   1 // Full power, measuring the rise
+#define PHASE_RELAY  2 // Holding the test temp with the relay
+#define PHASE_DONE   3 // Show the model until a button is pressed
+#define PHASE_ABORT  4 // Aborted or done
+
+const char STEP_FSTR[] PROGMEM = "Autotune: step";
+const char RELAY_FSTR[] PROGMEM = "Autotune: relay";
+
+int currentPhase(PHASE_INIT);
+int coroutinePhase(PHASE_INIT);
+Coroutine phaseCoroutine;
+int outputType[4];
+int elementDutyCounter[4];
+bool relayOn;
+int testTemp;                   // Quarter degrees
+int startTemp;                  // Quarter degrees
+unsigned long phaseStartTime;
+
+// Step
+int recentTemps[SLOPE_SECONDS + 1]; // The temp at the end of each of the last few seconds
+int seconds;                    // Seconds since the step started
+int maxSlope;                   // The most the temp rose in SLOPE_SECONDS (quarter degrees)
+int deadTime;                   // Seconds
+
+// Relay
+int cycle;                      // -1 until the relay first turns on again
+unsigned long cycleStartTime;
+unsigned long lastSwitchTime;
+unsigned long onTime;           // ms on in the measured cycles
+long tempSum;                   // Sum of the temp every tick in the measured cycles
+long ticks;
+int minTemp, maxTemp;           // Lowest and highest temps in the measured cycles
+
+int gain;                       // 0.1C per %
+int timeConstant;               // Seconds
+
+// Drive the outputs: heating elements at full power or off, convection fans on
+void setOutputs(bool heat)
+{
+	for ( int i = 0; i < 4; ++i )
+	{
+		switch ( outputType[i] )
+		{
+		case TYPE_TOP_ELEMENT:
+		case TYPE_BOTTOM_ELEMENT:
+			digitalWrite(4 + i, heat ? HIGH : LOW);
+			break;
+
+		case TYPE_BOOST_ELEMENT:
+			digitalWrite(4 + i, heat && elementDutyCounter[i] < BOOST_MAX_DUTY ? HIGH : LOW);
+			break;
+
+		case TYPE_CONVECTION_FAN:
+			digitalWrite(4 + i, HIGH);
+			break;
+
+		default:
+			break; // Skip unused outputs and cooling fans
+		}
+
+		elementDutyCounter[i] = (elementDutyCounter[i] + 1) % 100;
+	}
+}
+
+void allOff(void)
+{
+	for ( int i = 4; i < 8; ++i )
+		digitalWrite(i, LOW);
+}
+
+void abortAutotune(const __FlashStringHelper *reason)
+{
+	allOff();
+	lcdPrintLineF(0, F("Autotune failed"));
+	lcdPrintLineF(1, reason);
+	serialLog.print(F("Autotune aborted: "));
+	serialLog.println(reason);
+	currentPhase = PHASE_ABORT;
+}
+
+void thermocoupleFault(int fault)
+{
+	serialLog.print(F("Thermocouple Error: "));
+	serialLog.println(fault);
+	abortAutotune(F("Thermocouple err"));
+}
+
+// Print the temp to the serial port once a second so it can be plotted
+void displayAutotuneTemp(const int temp, const unsigned long currentTime)
+{
+	displayTemp(temp);
+
+	const unsigned long elapsed((currentTime - phaseStartTime) / MILLIS_TO_SECONDS);
+
+	if ( Telemetry::isBinary() )
+	{
+		int duty[4];
+
+		for ( int i = 0; i < 4; ++i )
+			duty[i] = relayOn && isHeatingElement(outputType[i])
+				? (outputType[i] == TYPE_BOOST_ELEMENT ? BOOST_MAX_DUTY : 100) : 0;
+
+		Telemetry::sample(TELEMETRY_AUTOTUNE, currentPhase, temp, duty, elapsed, testTemp, cycle);
+		return;
+	}
+
+	serialLog.print(elapsed);
+	serialLog.print(F(", "));
+	serialLog.print(relayOn);
+	serialLog.print(F(", "));
+	printTemp(serialLog, temp);
+	serialLog.println();
+}
+
+void phaseInit(const int currentTemp)
+{
+	CO_BEGIN(phaseCoroutine);
+
+	for ( int i = 0; i < 4; ++i )
+		outputType[i] = Settings::get(Settings::D4_TYPE + i);
+
+	if ( ! isHeatingElement(outputType[0]) && ! isHeatingElement(outputType[1])
+			&& ! isHeatingElement(outputType[2]) && ! isHeatingElement(outputType[3]) )
+	{
+		abortAutotune(F("No elements"));
+		return;
+	}
+
+	// Test half way to the max temp.  That is the middle of the bake range and the start
+	// of the presoak, so the model fits both.
+	testTemp = TEMP_C(Settings::get(Settings::MAX_TEMP) / 2);
+
+	// The step must start from a cool oven
+	if ( currentTemp > TEMP_C(50) )
+	{
+		lcdPrintLineF(0, F("Temp > 50\1C"));
+		lcdPrintLineF(1, F("Please wait..."));
+		serialLog.println(F("Oven too hot to start autotune.  Please wait ..."));
+		CO_DELAY(phaseCoroutine, 3000);
+		currentPhase = PHASE_ABORT;
+		return;
+	}
+
+	startTemp = currentTemp;
+
+	for ( int i = 0; i <= SLOPE_SECONDS; ++i )
+		recentTemps[i] = currentTemp;
+
+	seconds = 0;
+	maxSlope = 0;
+	deadTime = 0;
+	relayOn = true;
+
+	for ( int i = 0; i < 4; ++i )
+		elementDutyCounter[i] = i * 25;
+
+	serialLog.print(F("Autotune.  Test temp = "));
+	printTemp(serialLog, testTemp);
+	serialLog.println();
+	lcdPrintLineF(0, (const __FlashStringHelper *) STEP_FSTR);
+	lcdPrintLine(1, "");
+
+	currentPhase = PHASE_STEP;
+	phaseStartTime = millis();
+
+	CO_END(phaseCoroutine);
+}
+
+void phaseStep(const int currentTemp, const unsigned long currentTime)
+{
+	setOutputs(true);
+
+	if ( ! Scheduler::isNewSecond() )
+		return;
+
+	// Once a second
+	++seconds;
+	displayAutotuneTemp(currentTemp, currentTime);
+
+	for ( int i = 0; i < SLOPE_SECONDS; ++i )
+		recentTemps[i] = recentTemps[i + 1];
+
+	recentTemps[SLOPE_SECONDS] = currentTemp;
+
+	// The steepest part of the rise, and where its tangent crosses the start temp
+	const int slope(currentTemp - recentTemps[0]);
+
+	if ( seconds >= SLOPE_SECONDS && slope > maxSlope )
+	{
+		const int midSeconds(seconds - SLOPE_SECONDS / 2);
+		const int midTemp((currentTemp + recentTemps[0]) / 2);
+
+		maxSlope = slope;
+		deadTime = midSeconds - (long) (midTemp - startTemp) * SLOPE_SECONDS / slope;
+	}
+
+	if ( currentTemp >= testTemp - TEMP_C(AUTOTUNE_HYSTERESIS) )
+	{
+		if ( maxSlope <= 0 )
+		{
+			abortAutotune(F("No rise"));
+			return;
+		}
+
+		currentPhase = PHASE_RELAY;
+		lcdPrintLineF(0, (const __FlashStringHelper *) RELAY_FSTR);
+		cycle = -1;
+		lastSwitchTime = currentTime;
+		serialLog.println(F("Step done.  Starting the relay test"));
+		return;
+	}
+
+	if ( currentTime - phaseStartTime > AUTOTUNE_STEP_LIMIT * 60 * MILLIS_TO_SECONDS )
+		abortAutotune(F("Heats too slowly"));
+}
+
+// Work out the model from the measurements and save it
+void finish(const unsigned long currentTime)
+{
+	const unsigned long period((currentTime - cycleStartTime) / AUTOTUNE_CYCLES);
+	const int dutyPermille(onTime * 1000 / (currentTime - cycleStartTime));
+	const int meanTemp(tempSum / ticks);
+
+	allOff();
+
+	if ( dutyPermille <= 0 || meanTemp <= startTemp )
+	{
+		abortAutotune(F("Bad result"));
+		return;
+	}
+
+	// K (0.1C per %) = rise / duty = (rise / 4) / (dutyPermille / 10) * 10
+	gain = constrain((long) (meanTemp - startTemp) * 25 / dutyPermille, 1L, 255L);
+	// T = K * 100% / slope
+	timeConstant = constrain((long) gain * 10 * SLOPE_SECONDS * TEMP_SCALE / maxSlope, 1L, 2550L);
+	deadTime = constrain(deadTime, 1, 255);
+
+	OvenModel::save(gain, timeConstant, deadTime);
+
+	// Start learning over with duty cycles from the model
+	Settings::set(Settings::SETTINGS_CHANGED, true);
+
+	serialLog.print(F("Model: K = "));
+	serialLog.print(gain / 10);
+	serialLog.print('.');
+	serialLog.print(gain % 10);
+	serialLog.print(F(" C/%, T = "));
+	serialLog.print(timeConstant);
+	serialLog.print(F(" s, L = "));
+	serialLog.print(deadTime);
+	serialLog.println(F(" s"));
+
+	// Ultimate gain = 4d / (pi * a), d = 50% and a = half the peak to peak temp
+	const int amplitude(maxTemp - minTemp); // Peak to peak, quarter degrees
+
+	serialLog.print(F("Relay: period = "));
+	serialLog.print(period / MILLIS_TO_SECONDS);
+	serialLog.print(F(" s, peak to peak = "));
+	printTemp(serialLog, amplitude);
+	serialLog.print(F(" C, ultimate gain = "));
+	serialLog.print(amplitude ? 400L * TEMP_SCALE * 100 / (314L * amplitude) : 0L);
+	serialLog.println(F(" %/C"));
+
+	// Like "K9.2 T484 L19"
+	lcdPrintLineF(0, F("Autotune done"));
+	lcdPrintLine(1, "");
+	lcd.setCursor(0, 1);
+	lcd.print('K');
+	lcd.print(gain / 10);
+	lcd.print('.');
+	lcd.print(gain % 10);
+	lcd.print(F(" T"));
+	lcd.print(timeConstant);
+	lcd.print(F(" L"));
+	lcd.print(deadTime);
+	Tunes::playReflowComplete();
+	currentPhase = PHASE_DONE;
+}
+
+void phaseRelay(const int currentTemp, const unsigned long currentTime)
+{
+	if ( relayOn && currentTemp > testTemp + TEMP_C(AUTOTUNE_HYSTERESIS) )
+	{
+		relayOn = false;
+
+		if ( cycle > 0 )
+			onTime += currentTime - lastSwitchTime;
+
+		lastSwitchTime = currentTime;
+	}
+	else if ( ! relayOn && currentTemp < testTemp - TEMP_C(AUTOTUNE_HYSTERESIS) )
+	{
+		// A cycle starts each time the relay turns on.  The first one is left to settle.
+		relayOn = true;
+		lastSwitchTime = currentTime;
+
+		if ( ++cycle == 1 )
+		{
+			cycleStartTime = currentTime;
+			onTime = 0;
+			tempSum = 0;
+			ticks = 0;
+			minTemp = maxTemp = currentTemp;
+		}
+		else if ( cycle > AUTOTUNE_CYCLES )
+		{
+			finish(currentTime);
+			return;
+		}
+	}
+
+	if ( cycle > 0 )
+	{
+		tempSum += currentTemp;
+		++ticks;
+		if ( currentTemp < minTemp )
+			minTemp = currentTemp;
+
+		if ( currentTemp > maxTemp )
+			maxTemp = currentTemp;
+	}
+
+	setOutputs(relayOn);
+
+	if ( Scheduler::isNewSecond() )
+		displayAutotuneTemp(currentTemp, currentTime);
+
+	if ( currentTime - phaseStartTime > (AUTOTUNE_STEP_LIMIT + AUTOTUNE_RELAY_LIMIT) * 60 * MILLIS_TO_SECONDS )
+		abortAutotune(F("Won't oscillate"));
+}
+
+void phaseAbort(void)
+{
+	CO_BEGIN(phaseCoroutine);
+
+	allOff();
+	serialLog.println(F("Autotune is done!"));
+
+	// Wait for a bit to allow the user to read the last message
+	CO_DELAY(phaseCoroutine, 3000);
+
+	currentPhase = PHASE_INIT;
+
+	CO_END(phaseCoroutine);
+}
+
+} // namespace
+
+// Return false to exit this mode
+bool Autotune(void)
+{
+	const unsigned long currentTime(millis());
+	int currentTemp(0);
+	int fault(getCurrentTemp(currentTemp));
+	const int button(getButton());
+
+	if ( fault && currentPhase != PHASE_ABORT && currentPhase != PHASE_DONE )
+		thermocoupleFault(fault);
+
+	if ( button != CONTROLEO_BUTTON_NONE )
+	{
+		if ( currentPhase == PHASE_DONE )
+			currentPhase = PHASE_ABORT;
+		else if ( currentPhase != PHASE_ABORT )
+			abortAutotune(F("Button pressed"));
+	}
+
+	if ( currentPhase != coroutinePhase )
+	{
+		coroutinePhase = currentPhase;
+		phaseCoroutine.reset();
+	}
+
+	switch ( currentPhase )
+	{
+	case PHASE_INIT:
+		phaseInit(currentTemp);
+		break;
+
+	case PHASE_STEP:
+		phaseStep(currentTemp, currentTime);
+		break;
+
+	case PHASE_RELAY:
+		phaseRelay(currentTemp, currentTime);
+		break;
+
+	case PHASE_DONE:
+		break;
+
+	case PHASE_ABORT:
+		phaseAbort();
+
+		if ( currentPhase == PHASE_INIT )
+			return false; // Return to the main menu
+
+		break;
+	}
+
+	return true;
+}
+
+bool OvenModel::isValid(void)
+{
+	return Settings::get(Settings::AUTOTUNE_GAIN) != 0;
+}
+
+void OvenModel::save(int gain, int timeConstant, int deadTime)
+{
+	Settings::set(Settings::AUTOTUNE_GAIN, gain);
+	Settings::set(Settings::AUTOTUNE_TIME_CONSTANT, (timeConstant + 5) / 10);
+	Settings::set(Settings::AUTOTUNE_DEAD_TIME, deadTime);
+}
+
+// The percentage of full power that takes the oven from one temp to another (C) in the
+// given time.  From T * dtemp/dt = K * power - (temp - ambient), at the average temp.
+// The heat already in the elements keeps the previous power acting for about two dead times
+// (the tangent's dead time is shorter than the elements' lag), so the rest makes up for it.
+int OvenModel::rampPower(int fromTemp, int toTemp, int seconds, int previousPower)
+{
+	const long gain(Settings::get(Settings::AUTOTUNE_GAIN));
+	const long timeConstant(Settings::get(Settings::AUTOTUNE_TIME_CONSTANT) * 10L);
+	const long deadTime(Settings::get(Settings::AUTOTUNE_DEAD_TIME));
+
+	if ( ! gain || seconds <= 0 )
+		return 0;
+
+	const long aboveAmbient((fromTemp + toTemp) / 2 - OVEN_AMBIENT);
+	long power((aboveAmbient * seconds + timeConstant * (toTemp - fromTemp)) * 10 / (gain * seconds));
+
+	if ( previousPower >= 0 && 2 * deadTime < seconds )
+		power = (power * seconds - previousPower * 2 * deadTime) / (seconds - 2 * deadTime);
+
+	return constrain(power, 0L, 100L);
+}
+
+// PID gains for the bake (in Settings::BAKE_KP etc units) from the SIMC rules, with the
+// closed loop time constant twice the dead time (the oven is slower than the model).  Ti
+// is T rather than SIMC's min(T, 12L), so the I term doesn't overshoot after the heatup.
+//   Kc = T / (K * 3L), Ti = T, Td = L
+void OvenModel::bakeGains(int &kp, int &ki, int &kd)
+{
+	const long gain(Settings::get(Settings::AUTOTUNE_GAIN));
+	const long timeConstant(Settings::get(Settings::AUTOTUNE_TIME_CONSTANT) * 10L);
+	const long deadTime(Settings::get(Settings::AUTOTUNE_DEAD_TIME));
+
+	if ( ! gain || ! deadTime )
+		return;
+
+	// Kp is 0.1% per degree: 10 * T / (K * 3L), with K in 0.1C per %
+	kp = constrain(100 * timeConstant / (gain * 3 * deadTime), 1L, 255L);
+	// Ki is 0.0001% per degree second: Kc / Ti * 10000
+	ki = constrain(kp * 1000L / timeConstant, 1L, 255L);
+	// Kd is 1% per degree per second: Kc * Td
+	kd = constrain(kp * deadTime / 10, 1L, 255L);
+}
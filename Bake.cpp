@@ -1,13 +1,49 @@
 // Bake logic
 // Called from the main loop 20 times per second
 // This where the bake logic is controlled
+//
+// The oven temp is held by a PID controller, run once per second in the heatup and bake
+// phases.  It is all fixed point: temps are quarter degrees and the duty cycle is a
+// percentage with 8 fractional bits (DUTY_ONE is 1%).
+// - P acts on the error.
+// - I is only integrated while the output isn't saturated in the same direction, and is
+//   clamped to 0-100%, so it doesn't wind up during the heatup.  It starts at a guess of
+//   the duty cycle needed to hold the bake temp.
+// - D acts on the change in temp rather than the change in error, so it doesn't kick when
+//   the set point changes.  It is smoothed, because a quarter degree step is a big slope.
+// The gains are settings (see Settings::BAKE_KP), 0 meaning the default (from the oven model
+// if it has been autotuned).
+// The fraction of the duty cycle that doesn't fit in a whole percent is carried over to
+// the next second, so the average duty cycle is as fine as the PID output.
+//
+// Drying presets (see DryingPresets.cpp) can limit how fast the oven heats up.  The set
+// point then rises from the starting temp at the ramp limit, instead of jumping to the
+// bake temp.
+//
+// A long bake shouldn't start over after a power cut.  Every few minutes, what is being
+// baked and the time left are saved to the journal (Journal::RESUME).  At power on, if the
+// bake hadn't finished and the oven is still warm, it carries on (see resumeBake).
 
 #include <Arduino.h>
 #include "ReflowWizard.h"
+#include "Coroutine.h"
+#include "TelemetryFormat.h"
 
 namespace {
 
-#define MILLIS_TO_SECONDS ((long) 1000)
+#define DUTY_SHIFT 8
+#define DUTY_ONE   (1L << DUTY_SHIFT)   // 1% duty cycle
+#define DUTY_MAX   (100L << DUTY_SHIFT) // 100% duty cycle
+
+// Default gains (see Settings::BAKE_KP, BAKE_KI and BAKE_KD for the units)
+#define DEFAULT_KP 40 // 4% per degree
+#define DEFAULT_KI 25 // 0.0025% per degree second
+#define DEFAULT_KD 70 // 70% per degree per second
+
+// The integral is kept as the sum of error (quarter degrees) * Ki each second.
+// I term = integral * DUTY_ONE / (TEMP_SCALE * 10000) = integral * 4 / 625
+#define INTEGRAL_TO_DUTY(i) ((i) * 4 / 625)
+#define DUTY_TO_INTEGRAL(d) ((d) * 625 / 4)
 
 #define PHASE_INIT          0 // Initialize baking, check oven temp
 #define PHASE_HEATUP        1 // Heat up the oven rapidly to just under the desired temp
@@ -16,60 +52,227 @@ namespace {
 #define PHASE_COOLING       4 // Wait till the oven has cooled down to 50°C
 #define PHASE_ABORT         5 // Baking was aborted or completed
 
+#define CHECKPOINT_SECONDS 300 // How often the time left is saved
+#define RESUME_MAX_DROP     15 // Only resume if the oven is within 15C of the bake temp
+#define RESUME_MIN_TEMP     35 // ... and warmer than a hot room
+#define NO_PRESET         0xFF // The checkpoint is for Bake, not a drying preset
+
+// Saved to the journal, so it has to fit in Journal::DATA_SIZE
+struct Checkpoint
+{
+	uint8_t active;     // False once the bake has finished or been aborted
+	uint8_t preset;     // The drying preset (for the name), or NO_PRESET
+	uint8_t temp;       // C
+	uint16_t seconds;   // Bake time left
+	uint8_t doorOpen;
+	uint8_t rampLimit;
+};
+
 const char NULL_FSTR[] PROGMEM = "";
 const char HEATING_FSTR[] PROGMEM = "Heating";
 const char BAKING_FSTR[] PROGMEM = "Baking";
-const char REFRESHING_PLA_FSTR[] PROGMEM = "Refreshing PLA";
-const char DRYING_PLA_FSTR[] PROGMEM = "Drying PLA";
-const char DRYING_ABS_FSTR[] PROGMEM = "Drying ABS";
-const char DRYING_PETG_FSTR[] PROGMEM = "Drying PETG";
-const char DRYING_NYLON_FSTR[] PROGMEM = "Drying Nylon";
-const char DRYING_DESICCANT_FSTR[] PROGMEM = "Drying Desiccant";
 const char COOLING_FSTR[] PROGMEM = "Cooling";
-const char *phaseDesc[] = { NULL_FSTR, HEATING_FSTR, BAKING_FSTR, NULL_FSTR, COOLING_FSTR, NULL_FSTR };
+const char *const phaseDesc[] PROGMEM = { NULL_FSTR, HEATING_FSTR, NULL_FSTR, NULL_FSTR, COOLING_FSTR, NULL_FSTR };
 
 int currentPhase(PHASE_INIT);
 int outputType[4];
 int bakeTemp;
 uint32_t bakeDuration;
 bool doorOpen;
+char bakeName[16];   // Shown in the bake phase
+int rampLimit;       // C per minute (0 = no limit)
 bool parmsSet;
 int elementDutyCounter[4];
-int bakeDutyCycle;
-int bakeIntegral;
-int counter;
+int bakeDutyCycle;   // Whole percent, used by manageHeating
 int coolingDuration;
 bool isHeating;
-long lastOverTempTime;
+uint8_t bakePreset(NO_PRESET);
+bool isCheckpointed; // There is an active checkpoint in the journal
+unsigned long phaseStartTime; // For the run history
+
+// PID controller (duty cycles and terms are DUTY_ONE per percent)
+int kp, ki, kd;
+long pidIntegral;    // Sum of error * ki
+long pidP, pidD;     // The last P and D terms, for display
+long dutyCarry;      // The fraction of a percent not used yet
+int lastTemp;
+int rampStart;       // The temp the set point ramps up from
+uint32_t rampSeconds;
+Coroutine phaseCoroutine; // Lets a phase show a message for a while without blocking
+int coroutinePhase(PHASE_INIT);
+unsigned int abortMessageTime; // How long to leave the abort message on the screen (ms)
+
+// Get a gain from the settings (0 = the default)
+int getGain(int settingNum, int defaultGain)
+{
+	const int gain(Settings::get(settingNum));
+
+	return gain ? gain : defaultGain;
+}
+
+void pidInit(void)
+{
+	// The autotuned oven model gives better defaults than the fixed ones
+	int modelKp(DEFAULT_KP), modelKi(DEFAULT_KI), modelKd(DEFAULT_KD);
+
+	OvenModel::bakeGains(modelKp, modelKi, modelKd);
+	kp = getGain(Settings::BAKE_KP, modelKp);
+	ki = getGain(Settings::BAKE_KI, modelKi);
+	kd = getGain(Settings::BAKE_KD, modelKd);
+
+	// Start the I term at the duty cycle that holds the bake temp (from the model, or a
+	// guess), so it doesn't have to integrate all the way up from 0
+	const long holdDuty(OvenModel::isValid() ? OvenModel::holdPower(bakeTemp) * DUTY_ONE
+		: map(bakeTemp, 0, 250, 0, 100) * DUTY_ONE / 4);
+
+	pidIntegral = DUTY_TO_INTEGRAL(holdDuty);
+	pidP = pidD = 0;
+	dutyCarry = 0;
+	lastTemp = TEMP_FAULT;
+	rampStart = TEMP_FAULT;
+	rampSeconds = 0;
+	bakeDutyCycle = 0;
+}
+
+// The set point rises from the starting temp at the ramp limit, until it gets to the bake temp
+int pidSetpoint(const int currentTemp)
+{
+	if ( ! rampLimit )
+		return TEMP_C(bakeTemp);
+
+	if ( rampStart == TEMP_FAULT )
+		rampStart = currentTemp;
+
+	const long setpoint(rampStart + (long) rampSeconds * TEMP_C(rampLimit) / 60);
+
+	if ( setpoint >= TEMP_C(bakeTemp) )
+		return TEMP_C(bakeTemp);
+
+	++rampSeconds;
+	return setpoint;
+}
+
+// Work out the new duty cycle (called once per second)
+void pidUpdate(const int currentTemp)
+{
+	const long error(pidSetpoint(currentTemp) - currentTemp);
+
+	// P: Kp is 0.1% per degree.  error * DUTY_ONE * kp / (TEMP_SCALE * 10)
+	pidP = error * kp * 32 / 5;
+
+	// D: Kd is 1% per degree per second.  -change * DUTY_ONE * kd / TEMP_SCALE
+	if ( lastTemp != TEMP_FAULT )
+		pidD += (-(long) (currentTemp - lastTemp) * kd * 64 - pidD) / 4;
+
+	lastTemp = currentTemp;
+
+	// I: Ki is 0.0001% per degree second.  Don't integrate if the output is already
+	// saturated in the direction the error would push it (anti-windup).
+	long output(pidP + INTEGRAL_TO_DUTY(pidIntegral) + pidD);
+
+	if ( ! (error > 0 && output >= DUTY_MAX) && ! (error < 0 && output <= 0) )
+	{
+		pidIntegral = constrain(pidIntegral + error * ki, 0L, DUTY_TO_INTEGRAL(DUTY_MAX));
+		output = pidP + INTEGRAL_TO_DUTY(pidIntegral) + pidD;
+	}
+
+	// Use whole percents, carrying the rest over to the next second
+	const long duty(constrain(output, 0L, DUTY_MAX) + dutyCarry);
+
+	bakeDutyCycle = duty >> DUTY_SHIFT;
+	dutyCarry = duty - ((long) bakeDutyCycle << DUTY_SHIFT);
+}
+
+// Clip a term to what fits in the telemetry
+int termToInt(long term)
+{
+	return constrain(term, -32767L, 32767L);
+}
 
 // Display the current temp to the LCD screen and print it to the serial port so it can be plotted
-void displayBakeTime(uint32_t duration, const double temp, int duty, int integral)
+void displayBakeTime(uint32_t duration, const int temp)
 {
+	const int duty(bakeDutyCycle);
+	const long integral(INTEGRAL_TO_DUTY(pidIntegral));
+
 	displayTemp(temp);
+	History::sample(temp);
+
+	if ( Telemetry::isBinary() )
+	{
+		int outputDuty[4];
+
+		for ( int i = 0; i < 4; ++i )
+		{
+			switch ( outputType[i] )
+			{
+			case TYPE_TOP_ELEMENT:
+			case TYPE_BOTTOM_ELEMENT: outputDuty[i] = duty; break;
+			case TYPE_BOOST_ELEMENT: outputDuty[i] = duty / 2; break;
+			default: outputDuty[i] = 0; break;
+			}
+		}
+
+		Telemetry::sample(TELEMETRY_BAKE, currentPhase, temp, outputDuty, duration
+			, termToInt(pidP), termToInt(integral), termToInt(pidD));
+		return;
+	}
 
-	char buf[100];
 	// Write the time and temp to the serial port, for graphing or analysis on a PC
-	snprintf(buf, sizeof(buf), "%lu, %i, %i, ", duration, duty, integral);
-	Serial.print(buf);
-	Serial.println(temp);
+	serialLog.print(duration);
+	serialLog.print(F(", "));
+	serialLog.print(duty);
+	serialLog.print(F(", "));
+	serialLog.print((int) (integral >> DUTY_SHIFT));
+	serialLog.print(F(", "));
+	printTemp(serialLog, temp);
+	serialLog.println();
 
 	displayDuration(10, duration);
 }
 
+// Save the bake so it can be resumed after a power cut.  Written in the background.
+void checkpoint(bool active)
+{
+	Checkpoint c;
+	uint8_t data[Journal::DATA_SIZE] = {0};
+
+	if ( ! active && ! isCheckpointed )
+		return;
+
+	c.active = active;
+	c.preset = bakePreset;
+	c.temp = bakeTemp;
+	c.seconds = bakeDuration;
+	c.doorOpen = doorOpen;
+	c.rampLimit = rampLimit;
+	memcpy(data, &c, sizeof(c));
+	Journal::post(Journal::RESUME, data);
+	isCheckpointed = active;
+}
+
+void displayPhase(void)
+{
+	if ( currentPhase == PHASE_BAKE )
+		lcdPrintLine(0, bakeName);
+	else
+		lcdPrintLineF(0, (const __FlashStringHelper *) pgm_read_ptr(&phaseDesc[currentPhase]));
+}
+
 void thermocoupleFault(int fault)
 {
 	lcdPrintLineF(0, F("Thermocouple err"));
-	Serial.print(F("Thermocouple Error: "));
+	serialLog.print(F("Thermocouple Error: "));
 
 	switch ( fault )
 	{
 	case 1:
 		lcdPrintLineF(1, F("Fault open"));
-		Serial.println(F("Fault open"));
+		serialLog.println(F("Fault open"));
 		break;
 	case 2:
 		lcdPrintLineF(1, F("Short to GND"));
-		Serial.println(F("Short to ground"));
+		serialLog.println(F("Short to ground"));
 		break;
 	case 3:
 		lcdPrintLineF(1, F("Short to VCC"));
@@ -77,9 +280,10 @@ void thermocoupleFault(int fault)
 	}
 
 	// Abort the bake
-	Serial.println(F("Bake aborted because of thermocouple error!"));
+	serialLog.println(F("Bake aborted because of thermocouple error!"));
 	currentPhase = PHASE_ABORT;
-	delay(3000);
+	History::end(History::THERMOCOUPLE);
+	abortMessageTime = 3000;
 }
 
 void abortBake(void)
@@ -87,8 +291,9 @@ void abortBake(void)
 	currentPhase = PHASE_ABORT;
 	lcdPrintLineF(0, F("Aborting bake"));
 	lcdPrintLineF(1, F("Button pressed"));
-	Serial.println(F("Button pressed.  Aborting bake ..."));
-	delay(2000);
+	serialLog.println(F("Button pressed.  Aborting bake ..."));
+	abortMessageTime = 2000;
+	History::end(History::BUTTON);
 }
 
 void phaseInit(void)
@@ -98,10 +303,10 @@ void phaseInit(void)
 	for ( int i = 0; i < 4; ++i )
 		outputType[i] = Settings::get(Settings::D4_TYPE + i);
 
-	Serial.print(F("Baking temp = "));
-	Serial.println(bakeTemp);
-	Serial.print(F("Baking duration = "));
-	Serial.println(bakeDuration);
+	serialLog.print(F("Baking temp = "));
+	serialLog.println(bakeTemp);
+	serialLog.print(F("Baking duration = "));
+	serialLog.println(bakeDuration);
 
 	for ( int i = 0; i < 4; ++i )
 	{
@@ -111,107 +316,74 @@ void phaseInit(void)
 
 	// Move to the next phase
 	currentPhase = PHASE_HEATUP;
-	lcdPrintLineF(0, (const __FlashStringHelper *)phaseDesc[currentPhase]);
+	displayPhase();
 	lcdPrintLine(1, "");
 
-	// Start with a duty cycle proportional to the desired temp
-	bakeDutyCycle = map(bakeTemp, 0, 250, 0, 100);
-
 	isHeating = true;
-	bakeIntegral = 0;
-	counter = 0;
+	pidInit();
 
 	// Stagger the element start cycle to avoid abrupt changes in current draw
 	// Simple method: there are 4 outputs so space them apart equally
 	for ( int i = 0; i< 4; ++i )
 		elementDutyCounter[i] = 25 * i;
+
+	checkpoint(true);
+	History::start(bakePreset == NO_PRESET ? History::BAKE : History::DRY, bakePreset);
+	phaseStartTime = millis();
+}
+
+// The time since the last phase started goes in the run history (as heatup, bake and cooling)
+void phaseDone(int phase)
+{
+	const unsigned long now(millis());
+
+	History::phaseDone(phase == PHASE_COOLING ? 2 : phase - PHASE_HEATUP, (now - phaseStartTime) / 1000);
+	phaseStartTime = now;
 }
 
-void phaseHeatup(bool displayBake, const double currentTemp)
+void phaseHeatup(bool displayBake, const int currentTemp)
 {
 	if ( displayBake )
 	{
 		// Display the remaining time
-		displayBakeTime(bakeDuration, currentTemp, bakeDutyCycle, bakeIntegral);
-
 		// Don't start decrementing bakeDuration until close to baking temp
+		displayBakeTime(bakeDuration, currentTemp);
+		pidUpdate(currentTemp);
 	}
 
 	// Is the oven close to the desired temp?
-	if ( bakeTemp - currentTemp < 15.0 )
+	if ( TEMP_C(bakeTemp) - currentTemp < TEMP_C(15) )
 	{
+		phaseDone(PHASE_HEATUP);
 		currentPhase = PHASE_BAKE;
-		lcdPrintLineF(0, (const __FlashStringHelper *)phaseDesc[currentPhase]);
-		// Reduce the duty cycle for the last 10 degrees
-		bakeDutyCycle = bakeDutyCycle / 3;
-		Serial.println(F("Move to bake phase"));
+		displayPhase();
+		serialLog.println(F("Move to bake phase"));
+		checkpoint(true);
 	}
 }
 
-void phaseBake(const double currentTemp)
+void phaseBake(const int currentTemp)
 {
-	displayBakeTime(bakeDuration, currentTemp, bakeDutyCycle, bakeIntegral);
+	displayBakeTime(bakeDuration, currentTemp);
 
 	if ( ! (--bakeDuration) ) // Has the bake duration been reached?
 	{
+		phaseDone(PHASE_BAKE);
 		currentPhase = PHASE_START_COOLING;
 		return;
 	}
 
-	// Is the oven too hot?
-	if ( currentTemp > bakeTemp )
-	{
-		if ( isHeating )
-		{
-			isHeating = false;
-
-			// Turn all heating elements off
-			for ( int i = 0; i < 4; ++i )
-			{
-				if ( isHeatingElement(outputType[i]) )
-					digitalWrite(4 + i, LOW);
-			}
-
-			// The duty cycle caused the temp to exceed the bake temp, so decrease it
-			// (but not more than once every 30 seconds)
-			if ( millis() - lastOverTempTime > (30 * MILLIS_TO_SECONDS) )
-			{
-				lastOverTempTime = millis();
+	if ( ! (bakeDuration % CHECKPOINT_SECONDS) )
+		checkpoint(true);
 
-				if ( bakeDutyCycle > 0 )
-					--bakeDutyCycle;
-			}
-
-			// Reset the bake integral, so it will be slow to increase the duty cycle again
-			bakeIntegral = 0;
-			Serial.println(F("Over-temp. Elements off"));
-		}
-
-		return;
-	}
-
-	isHeating = true;
-
-	// Increase the bake integral if not close to temp
-	if ( bakeTemp - currentTemp > 1.0 )
-		++bakeIntegral;
-
-	// Has the oven been under-temp for a while?
-	if ( bakeIntegral > 30 )
-	{
-		bakeIntegral = 0;
-
-		if ( bakeDutyCycle < 100 )
-			++bakeDutyCycle;
-
-		Serial.println(F("Under-temp. Increasing duty cycle"));
-	}
+	pidUpdate(currentTemp);
 }
 
 void phaseStartCooling(void)
 {
-	Serial.println(F("Starting cooling"));
+	serialLog.println(F("Starting cooling"));
 	isHeating = false;
+	checkpoint(false);
 
 	// Turn off all elements and turn on the fans
 	for ( int i = 0; i < 4; ++i )
@@ -231,7 +403,7 @@ void phaseStartCooling(void)
 
 	// Move to the next phase
 	currentPhase = PHASE_COOLING;
-	lcdPrintLineF(0, (const __FlashStringHelper*)phaseDesc[currentPhase]);
+	displayPhase();
 
 	// If a servo is attached, use it to open the door over 10 seconds
 	setServoPosition(Settings::get(Settings::SERVO_OPEN_DEGREES), 10000);
@@ -241,24 +413,31 @@ void phaseStartCooling(void)
 	coolingDuration = 60;
 }
 
-void phaseCooling(const double currentTemp)
+void phaseCooling(const int currentTemp)
 {
 	// Display the remaining time
-	displayBakeTime(bakeDuration, currentTemp, bakeDutyCycle, bakeIntegral);
+	displayBakeTime(bakeDuration, currentTemp);
 
 	if ( coolingDuration > 0 ) // Wait in this phase until the oven has cooled
 		--coolingDuration;
 
-	const double finishTemp(doorOpen ? 30.0 : 50.0);
+	const int finishTemp(doorOpen ? 30 : 50);
 
-	if ( currentTemp < finishTemp && coolingDuration == 0 )
+	if ( currentTemp < TEMP_C(finishTemp) && coolingDuration == 0 )
+	{
+		phaseDone(PHASE_COOLING);
 		currentPhase = PHASE_ABORT;
+		History::end(History::COMPLETED);
+	}
 }
 
 void phaseAbort(void)
 {
-	Serial.println(F("Bake is done!"));
+	CO_BEGIN(phaseCoroutine);
+
+	serialLog.println(F("Bake is done!"));
 	isHeating = false;
+	checkpoint(false);
 
 	// Turn all elements and fans off
 	for ( int i = 4; i < 8; ++i )
@@ -266,10 +445,17 @@ void phaseAbort(void)
 
 	// Close the oven door now, over 3 seconds
 	setServoPosition(Settings::get(Settings::SERVO_CLOSED_DEGREES), 3000);
+
+	// Leave an abort message on the screen long enough to be read
+	CO_DELAY(phaseCoroutine, abortMessageTime);
+
 	// Start next time with initialization
 	currentPhase = PHASE_INIT;
-
+	abortMessageTime = 0;
 	parmsSet = false;
+	bakePreset = NO_PRESET;
+
+	CO_END(phaseCoroutine);
 }
 
 void manageHeating(void)
@@ -280,23 +466,13 @@ void manageHeating(void)
 		{
 		case TYPE_TOP_ELEMENT:
 		case TYPE_BOTTOM_ELEMENT:
-			// Turn the output on at 0, and off at the duty cycle value
-			if ( elementDutyCounter[i] == 0 )
-				digitalWrite(4 + i, HIGH);
-
-			if ( elementDutyCounter[i] == bakeDutyCycle )
-				digitalWrite(4 + i, LOW);
-
+			// On from 0 up to the duty cycle value.  Comparing (rather than switching at
+			// exactly 0 and the duty cycle) means the PID can change the duty cycle at any time.
+			digitalWrite(4 + i, elementDutyCounter[i] < bakeDutyCycle ? HIGH : LOW);
 			break;
 
 		case TYPE_BOOST_ELEMENT: // Give it half the duty cycle of the other elements
-			// Turn the output on at 0, and off at the duty cycle value
-			if ( elementDutyCounter[i] == 0 )
-				digitalWrite(4 + i, HIGH);
-
-			if ( elementDutyCounter[i] == bakeDutyCycle / 2 )
-				digitalWrite(4 + i, LOW);
-
+			digitalWrite(4 + i, elementDutyCounter[i] < bakeDutyCycle / 2 ? HIGH : LOW);
 			break;
 
 		default:
@@ -311,24 +487,25 @@ void manageHeating(void)
 // Return false to exit this mode
 bool localBake(void)
 {
-	bool isOneSecondInterval(false);
+	const bool isOneSecondInterval(Scheduler::isNewSecond());
 
-	// Determine if this is on a 1-second interval
-	if ( ++counter >= 20 )
-	{
-		counter = 0;
-		isOneSecondInterval = true;
-	}
-
-	double currentTemp(0.0);
+	int currentTemp(0);
 	int fault(getCurrentTemp(currentTemp));
 
-	if ( fault )
+	// Once aborting, leave the message on the screen alone
+	if ( fault && currentPhase != PHASE_ABORT )
 		thermocoupleFault(fault);
 
-	if ( getButton() != CONTROLEO_BUTTON_NONE )
+	if ( getButton() != CONTROLEO_BUTTON_NONE && currentPhase != PHASE_ABORT )
 		abortBake();
 
+	// A phase that was part way through showing a message starts from the top if the phase changed
+	if ( currentPhase != coroutinePhase )
+	{
+		coroutinePhase = currentPhase;
+		phaseCoroutine.reset();
+	}
+
 	switch ( currentPhase )
 	{
 	case PHASE_INIT: // User has requested to start a bake
@@ -355,7 +532,11 @@ bool localBake(void)
 
 	case PHASE_ABORT:
 		phaseAbort();
-		return false; // Return to the main menu
+
+		if ( currentPhase == PHASE_INIT )
+			return false; // Return to the main menu
+
+		break;
 	}
 
 	if ( isHeating )
@@ -364,12 +545,13 @@ bool localBake(void)
 	return true;
 }
 
-void initParms(int temp, uint32_t duration, bool _doorOpen, const char *bakeDesc)
+void initParms(const DryingPreset &p)
 {
-	bakeTemp = temp;
-	bakeDuration = duration;
-	doorOpen = _doorOpen;
-	phaseDesc[PHASE_BAKE] = bakeDesc;
+	bakeTemp = p.temp;
+	bakeDuration = p.seconds;
+	doorOpen = p.doorOpen;
+	rampLimit = p.rampLimit;
+	strcpy(bakeName, p.name);
 
 	if ( doorOpen )
 	{
@@ -393,66 +575,92 @@ void initParms(int temp, uint32_t duration, bool _doorOpen, const char *bakeDesc
 bool Bake(void)
 {
 	if ( ! parmsSet )
-		initParms(Settings::get(Settings::BAKE_TEMP)
-				, getBakeSeconds(Settings::get(Settings::BAKE_DURATION))
-				, false, BAKING_FSTR);
+	{
+		DryingPreset p;
+
+		strcpy_P(p.name, BAKING_FSTR);
+		p.temp = Settings::get(Settings::BAKE_TEMP);
+		p.seconds = getBakeSeconds(Settings::get(Settings::BAKE_DURATION));
+		p.doorOpen = false;
+		p.rampLimit = 0;
+		initParms(p);
+	}
 
 	return localBake();
 }
 
-#define HOURS_1 (60UL*60UL)
-#define HOURS_2 (HOURS_1*2UL)
-#define HOURS_3 (HOURS_1*3UL)
-#define HOURS_4 (HOURS_1*4UL)
-#define HOURS_5 (HOURS_1*5UL)
-#define HOURS_13 (HOURS_1*13UL)
-
-bool RefreshPla(void)
+// Bake with a drying preset (see DryingPresets.cpp)
+bool Dry(int preset)
 {
 	if ( ! parmsSet )
-		initParms(63, HOURS_1, true, REFRESHING_PLA_FSTR);
+	{
+		DryingPreset p;
+
+		DryingPresets::get(preset, p);
+		initParms(p);
+		bakePreset = preset;
+	}
 
 	return localBake();
 }
 
-bool DryPla(void)
+// Carry on with a bake that was cut short by a power cut.  preset is set to the drying
+// preset, or -1 for Bake.  Returns false if there is nothing to resume.
+bool resumeBake(int &preset)
 {
-	if ( ! parmsSet )
-		initParms(45, HOURS_5, true, DRYING_PLA_FSTR);
+	uint8_t data[Journal::DATA_SIZE];
+	Checkpoint c;
 
-	return localBake();
-}
+	if ( ! Journal::read(Journal::RESUME, data) )
+		return false;
 
-bool DryAbs(void)
-{
-	if ( ! parmsSet )
-		initParms(62, HOURS_3, true, DRYING_ABS_FSTR);
+	memcpy(&c, data, sizeof(c));
 
-	return localBake();
-}
+	if ( ! c.active )
+		return false;
 
-bool DryPetg(void)
-{
-	if ( ! parmsSet )
-		initParms(65, HOURS_3, true, DRYING_PETG_FSTR);
+	// Forget it, so it isn't resumed again if it doesn't start
+	isCheckpointed = true;
+	checkpoint(false);
 
-	return localBake();
-}
+	int currentTemp(0);
 
-bool DryNylon(void)
-{
-	if ( ! parmsSet )
-		initParms(70, HOURS_13, true, DRYING_NYLON_FSTR);
+	if ( getCurrentTemp(currentTemp)
+			|| currentTemp < TEMP_C(c.temp - RESUME_MAX_DROP)
+			|| currentTemp < TEMP_C(RESUME_MIN_TEMP) )
+	{
+		serialLog.println(F("The oven has cooled.  Not resuming the bake"));
+		return false;
+	}
 
-	return localBake();
-}
+	DryingPreset p;
 
-bool DryDesiccant(void)
-{
-	if ( ! parmsSet )
-		initParms(65, HOURS_4, true, DRYING_DESICCANT_FSTR);
+	if ( c.preset != NO_PRESET && c.preset < DryingPresets::count() )
+		DryingPresets::get(c.preset, p);
+	else
+	{
+		c.preset = NO_PRESET;
+		strcpy_P(p.name, BAKING_FSTR);
+	}
 
-	return localBake();
+	p.temp = c.temp;
+	p.seconds = c.seconds;
+	p.doorOpen = c.doorOpen;
+	p.rampLimit = c.rampLimit;
+	initParms(p);
+	bakePreset = c.preset;
+
+	// The phase isn't saved: the bake starts again from the heatup phase, which moves straight
+	// on to baking since the oven is still close to the bake temp
+
+	serialLog.print(F("Resuming "));
+	serialLog.print(p.name);
+	serialLog.print(F(" with "));
+	serialLog.print(c.seconds);
+	serialLog.println(F(" seconds left"));
+
+	preset = c.preset == NO_PRESET ? -1 : c.preset;
+	return true;
 }
 
 // Returns the bake duration, in seconds (max 65536 = 18 hours)
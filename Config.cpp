@@ -2,12 +2,27 @@
 
 // Setup menu
 // Called from the main loop
-// Allows the user to configure the outputs and maximum temp
-
-const char *outputDesc[NO_OF_TYPES] = {"Unused", "Top", "Bottom", "Boost", "Convection Fan", "Cooling Fan"};
+// Allows the user to configure the outputs, maximum temp and reflow profile
 
 namespace {
 
+const char UNUSED_FSTR[] PROGMEM = "Unused";
+const char TOP_FSTR[] PROGMEM = "Top";
+const char BOTTOM_FSTR[] PROGMEM = "Bottom";
+const char BOOST_FSTR[] PROGMEM = "Boost";
+const char CONVECTION_FAN_FSTR[] PROGMEM = "Convection Fan";
+const char COOLING_FAN_FSTR[] PROGMEM = "Cooling Fan";
+
+// Indexed by TYPE_UNUSED etc.
+const char *const outputDesc[NO_OF_TYPES] PROGMEM = {
+	UNUSED_FSTR
+	, TOP_FSTR
+	, BOTTOM_FSTR
+	, BOOST_FSTR
+	, CONVECTION_FAN_FSTR
+	, COOLING_FAN_FSTR
+};
+
 int setupPhase;
 int output = 4;    // Start with output D4
 int type = TYPE_TOP_ELEMENT;
@@ -18,6 +33,10 @@ int servoDegreesIncrement = 5;
 int selectedServo = Settings::SERVO_OPEN_DEGREES;
 int bakeTemp;
 int bakeDuration;
+int profile;
+int presetSlot;
+int presetStep;    // What is being edited in the user preset (see editPresets)
+int presetValue;
 
 void setupOutputs(void)
 {
@@ -28,14 +47,14 @@ void setupOutputs(void)
 		lcd.setCursor(1, 0);
 		lcd.print(output);
 		type = Settings::get(Settings::D4_TYPE - 4 + output);
-		lcdPrintLine(1, outputDesc[type]);
+		lcdPrintLineF(1, outputName(type));
 	}
 
 	switch ( getButton() )
 	{
 	case CONTROLEO_BUTTON_TOP:
 		type = (type+1) % NO_OF_TYPES; // Move to the next type
-		lcdPrintLine(1, outputDesc[type]);
+		lcdPrintLineF(1, outputName(type));
 		break;
 
 	case CONTROLEO_BUTTON_BOTTOM:
@@ -47,7 +66,7 @@ void setupOutputs(void)
 			lcd.setCursor(1, 0);
 			lcd.print(output);
 			type = Settings::get(Settings::D4_TYPE - 4 + output);
-			lcdPrintLine(1, outputDesc[type]);
+			lcdPrintLineF(1, outputName(type));
 			break;
 		}
 
@@ -84,6 +103,30 @@ void getMaxTemp(void)
 	}
 }
 
+void getProfile(void)
+{
+	if ( drawMenu )
+	{
+		drawMenu = false;
+		lcdPrintLineF(0, F("Solder paste"));
+		profile = ReflowProfile::selected();
+		lcdPrintLineF(1, ReflowProfile::name(profile));
+	}
+
+	switch ( getButton() )
+	{
+	case CONTROLEO_BUTTON_TOP:
+		profile = (profile + 1) % ReflowProfile::count(); // Move to the next profile
+		lcdPrintLineF(1, ReflowProfile::name(profile));
+		break;
+
+	case CONTROLEO_BUTTON_BOTTOM:
+		Settings::set(Settings::REFLOW_PROFILE, profile);
+		++setupPhase;
+		break;
+	}
+}
+
 void getServoSettings(void)
 {
 	if ( drawMenu )
@@ -190,13 +233,169 @@ void getBakeDuration(void)
 	}
 }
 
+// The user's drying presets.  For each slot, choose the material (or empty), then its temp,
+// duration, whether the door is left open and the ramp limit.
+#define PRESET_ASK      0
+#define PRESET_MATERIAL 1
+#define PRESET_TEMP     2
+#define PRESET_DURATION 3
+#define PRESET_DOOR     4
+#define PRESET_RAMP     5
+
+void displayPresetValue(void)
+{
+	lcdPrintLine(1, "");
+	lcd.setCursor(0, 1);
+
+	switch ( presetStep )
+	{
+	case PRESET_MATERIAL:
+		if ( presetValue )
+			lcd.print(DryingPresets::materialName(presetValue));
+		else
+			lcd.print(F("Empty"));
+		break;
+
+	case PRESET_TEMP:
+		lcd.print(presetValue);
+		lcd.print("\1C ");
+		break;
+
+	case PRESET_DURATION:
+		displayDuration(0, getBakeSeconds(presetValue));
+		break;
+
+	case PRESET_DOOR:
+		lcd.print(presetValue ? F("Open") : F("Closed"));
+		break;
+
+	case PRESET_RAMP:
+		if ( presetValue )
+		{
+			lcd.print(presetValue);
+			lcd.print(F("\1C/min"));
+		}
+		else
+			lcd.print(F("No limit"));
+		break;
+	}
+}
+
+void editPresets(void)
+{
+	static const int fields[] = { 0, DryingPresets::SLOT_MATERIAL, DryingPresets::SLOT_TEMP
+		, DryingPresets::SLOT_DURATION, DryingPresets::SLOT_DOOR_OPEN, DryingPresets::SLOT_RAMP_LIMIT };
+
+	if ( drawMenu )
+	{
+		drawMenu = false;
+
+		if ( presetStep == PRESET_ASK )
+		{
+			lcdPrintLineF(0, F("Edit drying"));
+			lcdPrintLineF(1, F("presets?   No ->"));
+			return;
+		}
+
+		switch ( presetStep )
+		{
+		case PRESET_MATERIAL: lcdPrintLineF(0, F("User preset")); break;
+		case PRESET_TEMP: lcdPrintLineF(0, F("Drying temp")); break;
+		case PRESET_DURATION: lcdPrintLineF(0, F("Drying duration")); break;
+		case PRESET_DOOR: lcdPrintLineF(0, F("Door")); break;
+		case PRESET_RAMP: lcdPrintLineF(0, F("Ramp limit")); break;
+		}
+
+		if ( presetStep == PRESET_MATERIAL )
+		{
+			lcd.setCursor(12, 0);
+			lcd.print(presetSlot + 1);
+		}
+
+		presetValue = Settings::get(DryingPresets::slotSetting(presetSlot, fields[presetStep]));
+		displayPresetValue();
+	}
+
+	switch ( getButton() )
+	{
+	case CONTROLEO_BUTTON_TOP:
+		switch ( presetStep )
+		{
+		case PRESET_ASK:
+			presetSlot = 0;
+			presetStep = PRESET_MATERIAL;
+			drawMenu = true;
+			return;
+
+		case PRESET_MATERIAL:
+			presetValue = (presetValue + 1) % (DryingPresets::materialCount() + 1);
+			break;
+
+		case PRESET_TEMP:
+			presetValue += BAKE_TEMP_STEP;
+
+			if ( presetValue > BAKE_MAX_TEMP )
+				presetValue = BAKE_MIN_TEMP;
+			break;
+
+		case PRESET_DURATION:
+			++presetValue %= BAKE_MAX_DURATION;
+			break;
+
+		case PRESET_DOOR:
+			presetValue = ! presetValue;
+			break;
+
+		case PRESET_RAMP:
+			presetValue = (presetValue + 1) % 11; // Up to 10C per minute
+			break;
+		}
+
+		displayPresetValue();
+		break;
+
+	case CONTROLEO_BUTTON_BOTTOM:
+		drawMenu = true;
+
+		if ( presetStep == PRESET_ASK )
+		{
+			++setupPhase;
+			break;
+		}
+
+		if ( presetStep == PRESET_MATERIAL )
+		{
+			// A new material starts with its suggested settings
+			if ( presetValue != Settings::get(DryingPresets::slotSetting(presetSlot, DryingPresets::SLOT_MATERIAL)) )
+				DryingPresets::setMaterial(presetSlot, presetValue);
+		}
+		else
+			Settings::set(DryingPresets::slotSetting(presetSlot, fields[presetStep]), presetValue);
+
+		// Move to the next setting, or the next slot once done (or the slot is empty)
+		if ( presetStep == PRESET_RAMP || (presetStep == PRESET_MATERIAL && ! presetValue) )
+		{
+			presetStep = PRESET_MATERIAL;
+
+			if ( ++presetSlot == DryingPresets::USER_SLOTS )
+			{
+				presetStep = PRESET_ASK;
+				++setupPhase;
+			}
+		}
+		else
+			++presetStep;
+		break;
+	}
+}
+
 void restartLearning(void)
 {
 	if ( drawMenu )
 	{
 		drawMenu = false;
 
-		if ( ! Settings::get(Settings::LEARNING_MODE) )
+		if ( ! Settings::get(ReflowProfile::learningSetting(ReflowProfile::selected())) )
 		{
 			lcdPrintLineF(0, F("Restart learning"));
 			lcdPrintLineF(1, F("mode?      No ->"));
@@ -211,7 +410,7 @@ void restartLearning(void)
 	switch ( getButton() )
 	{
 	case CONTROLEO_BUTTON_TOP:
-		Settings::set(Settings::LEARNING_MODE, true);
+		Settings::set(ReflowProfile::learningSetting(ReflowProfile::selected()), true);
 		drawMenu = true;
 		break;
 
@@ -235,8 +434,7 @@ void restoreFactory(void)
 	case CONTROLEO_BUTTON_TOP:
 		lcdPrintLineF(0, F("Please wait ..."));
 		lcdPrintLine(1, "");
-		Settings::set(Settings::EEPROM_NEEDS_INIT, true);
-		Settings::ensureInitialized();
+		Settings::restoreDefaults();
 		break;
 
 	case CONTROLEO_BUTTON_BOTTOM:
@@ -257,11 +455,13 @@ bool Config(void)
 	{
 	case 0: setupOutputs(); break;
 	case 1: getMaxTemp(); break;
-	case 2: getServoSettings(); break;
-	case 3: getBakeTemp(); break;
-	case 4: getBakeDuration(); break;
-	case 5: restartLearning(); break;
-	case 6: restoreFactory(); break;
+	case 2: getProfile(); break;
+	case 3: getServoSettings(); break;
+	case 4: getBakeTemp(); break;
+	case 5: getBakeDuration(); break;
+	case 6: editPresets(); break;
+	case 7: restartLearning(); break;
+	case 8: restoreFactory(); break;
 	default: break;
 	}
 
@@ -269,7 +469,7 @@ bool Config(void)
 	if ( oldSetupPhase != setupPhase )
 		drawMenu = true;
 
-	if ( setupPhase > 6 )
+	if ( setupPhase > 8 )
 	{
 		setupPhase = 0;
 		return false;
@@ -278,6 +478,11 @@ bool Config(void)
 	return true;
 }
 
+const __FlashStringHelper *outputName(int type)
+{
+	return (const __FlashStringHelper *) pgm_read_ptr(&outputDesc[type]);
+}
+
 void displayMaxTemp(int temp)
 {
 	lcd.setCursor(0, 1);
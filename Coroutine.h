@@ -0,0 +1,42 @@
+#pragma once
+// Lightweight coroutines (protothreads)
+// The phase functions are called from the main loop 20 times per second, so they
+// must never wait.  A coroutine lets them be written as if they could:
+//
+//   CO_BEGIN(co);
+//   lcdPrintLineF(0, F("Learning Mode"));
+//   CO_DELAY(co, 3000);   // returns now, carries on from here 3 seconds later
+//   ...
+//   CO_END(co);
+//
+// This is the switch/case technique from Adam Dunkels' protothreads.  The rules are:
+//   - The function must return void
+//   - Local variables don't survive a CO_DELAY.  Use namespace variables instead
+//   - A CO_DELAY can't be inside another switch statement
+//   - Call reset() if the function should start from the top next time (e.g. the phase changed)
+
+#include <Arduino.h>
+
+struct Coroutine
+{
+	Coroutine() : line(0), waitStart(0) {}
+
+	void reset(void) { line = 0; }
+
+	uint16_t line;           // Where to carry on from (0 = the beginning)
+	unsigned long waitStart; // When the current CO_DELAY started
+};
+
+#define CO_BEGIN(co) switch ( (co).line ) { case 0:
+
+#define CO_DELAY(co, ms) \
+	do { \
+		(co).waitStart = millis(); \
+		(co).line = __LINE__; \
+		/* Falls through */ \
+	case __LINE__: \
+		if ( millis() - (co).waitStart < (unsigned long) (ms) ) \
+			return; \
+	} while ( 0 )
+
+#define CO_END(co) } (co).line = 0
@@ -0,0 +1,144 @@
+// Drying presets
+// The built in presets are a table in flash, so adding one is a line here rather than another
+// menu function.  After them come the user's presets, kept in EEPROM slots from
+// Settings::USER_PRESETS and edited in the Setup menu.  A user preset is a material from the
+// list below (which gives its name and suggested settings), with its own temp, duration, door
+// and ramp limit.  The main menu lists the built in presets, then the user slots in use.
+
+#include <Arduino.h>
+#include "ReflowWizard.h"
+
+namespace {
+
+struct PresetData
+{
+	char name[16];      // Leaves room for the "?" in the main menu
+	uint8_t temp;       // C
+	uint16_t minutes;
+	uint8_t doorOpen;
+	uint8_t rampLimit;  // C per minute (0 = no limit)
+};
+
+const PresetData presets[] PROGMEM = {
+	//  Name             Temp  Minutes  Door  Ramp
+	{ "Refresh PLA",     63,    60,     true, 0 }
+	, { "Dry PLA",       45,   300,     true, 0 }
+	, { "Dry ABS",       62,   180,     true, 0 }
+	, { "Dry PETG",      65,   180,     true, 0 }
+	, { "Dry Nylon",     70,   780,     true, 0 }
+	, { "Dry Desiccant", 65,   240,     true, 0 }
+};
+
+#define NO_OF_PRESETS ((int) (sizeof(presets) / sizeof(presets[0])))
+
+// The duration setting for a number of minutes (the reverse of getBakeSeconds)
+#define DURATION(minutes) ((minutes) <= 60 ? (minutes) - 5 \
+	: (minutes) <= 240 ? ((minutes) - 60) / 5 + 55 \
+	: ((minutes) - 240) / 10 + 91)
+
+struct MaterialData
+{
+	char name[12];      // "Dry " is added in front
+	uint8_t temp;       // Suggested settings
+	uint8_t duration;   // See getBakeSeconds
+	uint8_t rampLimit;
+};
+
+const MaterialData materials[] PROGMEM = {
+	//  Name        Temp  Duration        Ramp
+	{ "TPU",        50,   DURATION(240),  2 }
+	, { "ASA",      80,   DURATION(240),  0 }
+	, { "PC",       80,   DURATION(360),  0 }
+	, { "PVA",      45,   DURATION(360),  2 }
+	, { "HIPS",     70,   DURATION(240),  0 }
+	, { "PP",       60,   DURATION(240),  0 }
+	, { "Nylon CF", 75,   DURATION(480),  0 }
+	, { "Custom",   50,   DURATION(240),  0 }
+};
+
+#define NO_OF_MATERIALS ((int) (sizeof(materials) / sizeof(materials[0])))
+
+const char DRY_FSTR[] PROGMEM = "Dry ";
+
+} // namespace
+
+int DryingPresets::count(void)
+{
+	int n(NO_OF_PRESETS);
+
+	for ( int slot = 0; slot < USER_SLOTS; ++slot )
+	{
+		if ( Settings::get(slotSetting(slot, SLOT_MATERIAL)) )
+			++n;
+	}
+
+	return n;
+}
+
+void DryingPresets::get(int preset, DryingPreset &p)
+{
+	if ( preset < NO_OF_PRESETS )
+	{
+		const PresetData &d(presets[preset]);
+
+		strcpy_P(p.name, d.name);
+		p.temp = pgm_read_byte(&d.temp);
+		p.seconds = pgm_read_word(&d.minutes) * 60UL;
+		p.doorOpen = pgm_read_byte(&d.doorOpen);
+		p.rampLimit = pgm_read_byte(&d.rampLimit);
+		return;
+	}
+
+	// Skip the empty slots
+	preset -= NO_OF_PRESETS;
+	int slot(0);
+
+	for ( ; slot < USER_SLOTS - 1; ++slot )
+	{
+		if ( Settings::get(slotSetting(slot, SLOT_MATERIAL)) && ! preset-- )
+			break;
+	}
+
+	int material(Settings::get(slotSetting(slot, SLOT_MATERIAL)));
+
+	if ( material > NO_OF_MATERIALS )
+		material = NO_OF_MATERIALS; // Custom
+
+	strcpy_P(p.name, DRY_FSTR);
+	strcat_P(p.name, (const char *) materialName(material));
+	p.temp = constrain(Settings::get(slotSetting(slot, SLOT_TEMP)), BAKE_MIN_TEMP, BAKE_MAX_TEMP);
+	p.seconds = getBakeSeconds(Settings::get(slotSetting(slot, SLOT_DURATION)));
+	p.doorOpen = Settings::get(slotSetting(slot, SLOT_DOOR_OPEN));
+	p.rampLimit = Settings::get(slotSetting(slot, SLOT_RAMP_LIMIT));
+}
+
+int DryingPresets::slotSetting(int slot, int field)
+{
+	return Settings::USER_PRESETS + slot * SLOT_SETTINGS + field;
+}
+
+int DryingPresets::materialCount(void)
+{
+	return NO_OF_MATERIALS;
+}
+
+const __FlashStringHelper *DryingPresets::materialName(int material)
+{
+	return (const __FlashStringHelper *) materials[material - 1].name;
+}
+
+// Set the slot to the material, with its suggested settings.  0 empties the slot.
+void DryingPresets::setMaterial(int slot, int material)
+{
+	Settings::set(slotSetting(slot, SLOT_MATERIAL), material);
+
+	if ( ! material )
+		return;
+
+	const MaterialData &m(materials[material - 1]);
+
+	Settings::set(slotSetting(slot, SLOT_TEMP), pgm_read_byte(&m.temp));
+	Settings::set(slotSetting(slot, SLOT_DURATION), pgm_read_byte(&m.duration));
+	Settings::set(slotSetting(slot, SLOT_DOOR_OPEN), true);
+	Settings::set(slotSetting(slot, SLOT_RAMP_LIMIT), pgm_read_byte(&m.rampLimit));
+}
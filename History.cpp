@@ -0,0 +1,482 @@
+// Run history
+// Every reflow, bake and drying preset leaves a short summary in a ring in the EEPROM, so
+// past runs can be looked at without a PC having logged them ("h" serial command).  A run is
+// what was run, how long each phase took, the peak temp, the time above liquidus, how the
+// learning changed the duty cycles, how it ended and how many thermocouple faults and spikes
+// there were.
+//
+// Each record has a run number and a CRC.  The newest record is the one with the highest
+// run number, and the next run goes in the slot after it.  A record that was only partly
+// written (the power went off) fails the CRC check, and is skipped.
+//
+// For each reflow profile the mean and variance of the peak temp, the heating phase times
+// and the time above liquidus are kept across the completed runs, so drift in the oven shows
+// up.  They are updated one run at a time (Welford's method), in fixed point.  After
+// STATS_WINDOW runs the newest run keeps getting 1/STATS_WINDOW of the weight, so they
+// follow the oven as it ages rather than averaging over its whole life.
+//
+// The run is kept in RAM and written when the mode returns to the main menu (see flush).
+// The temp trace of the run (see Trace.cpp) is recorded and written along with it.
+
+#include <Arduino.h>
+#include <EEPROM.h>
+#include "ReflowWizard.h"
+
+namespace {
+
+// Between the settings header and the journal (see Settings and Journal.cpp)
+#define HISTORY_START   176
+#define NO_OF_RUNS        8
+#define STATS_START     (HISTORY_START + NO_OF_RUNS * sizeof(Run)) // 368, up to 544
+#define STATS_PROFILES   4 // Profiles with statistics
+
+#define STATS_WINDOW    32 // Runs before the statistics become a moving average
+#define STATS_SCALE     16 // Fixed point scale of the mean and variance
+#define STATS_MAX     2047 // Larger samples are clipped, so the sums fit in a long
+
+#define DUMP_LINE_SIZE 160 // Room needed in the serial log for a line of the dump
+
+struct Run
+{
+	uint16_t number;         // 1 is the first run.  The highest is the newest.
+	uint16_t phaseSeconds[History::PHASES];
+	int16_t peak;            // Quarter degrees
+	uint16_t aboveSeconds;   // Time above liquidus
+	uint16_t faults;         // Faulty thermocouple readings
+	uint8_t kind;            // History::REFLOW etc.
+	uint8_t variant;         // The reflow profile or drying preset
+	uint8_t result;          // History::COMPLETED etc.
+	uint8_t spikes;          // Thermocouple readings thrown away by the median filter
+	int8_t adjustments[3];   // Duty cycle changes in the presoak, soak and reflow phases
+	uint8_t crc;             // Of everything before it
+};
+
+// The statistics kept for each reflow profile
+enum {
+	STAT_PEAK
+	, STAT_PRESOAK
+	, STAT_SOAK
+	, STAT_REFLOW
+	, STAT_ABOVE_LIQUIDUS
+	, NO_OF_STATS
+};
+
+struct ProfileStats
+{
+	int32_t mean[NO_OF_STATS];     // * STATS_SCALE
+	int32_t variance[NO_OF_STATS]; // * STATS_SCALE
+	uint16_t count;                // Runs, up to STATS_WINDOW
+	uint8_t unused;                // Keeps the size the same on the host
+	uint8_t crc;
+};
+
+const char RESULT_COMPLETED_FSTR[] PROGMEM = "completed";
+const char RESULT_BUTTON_FSTR[] PROGMEM = "button pressed";
+const char RESULT_THERMOCOUPLE_FSTR[] PROGMEM = "thermocouple error";
+const char RESULT_TOO_FAST_FSTR[] PROGMEM = "too fast";
+const char RESULT_TOO_SLOW_FSTR[] PROGMEM = "too slow";
+const char *const resultDesc[History::RESULTS] PROGMEM = { RESULT_COMPLETED_FSTR
+	, RESULT_BUTTON_FSTR
+	, RESULT_THERMOCOUPLE_FSTR
+	, RESULT_TOO_FAST_FSTR
+	, RESULT_TOO_SLOW_FSTR };
+
+const char STAT_PEAK_FSTR[] PROGMEM = "  peak ";
+const char STAT_PRESOAK_FSTR[] PROGMEM = "  presoak ";
+const char STAT_SOAK_FSTR[] PROGMEM = "  soak ";
+const char STAT_REFLOW_FSTR[] PROGMEM = "  reflow ";
+const char STAT_ABOVE_FSTR[] PROGMEM = "  above liquidus ";
+const char *const statDesc[NO_OF_STATS] PROGMEM = { STAT_PEAK_FSTR
+	, STAT_PRESOAK_FSTR
+	, STAT_SOAK_FSTR
+	, STAT_REFLOW_FSTR
+	, STAT_ABOVE_FSTR };
+
+Run run;                 // The current run
+bool isRunning;          // Started, and hasn't ended yet
+bool isEnded;            // Ended, and not written yet
+int liquidusTemp;        // Quarter degrees (0 = not counted)
+uint16_t startFaults, startSpikes;
+int dumpItem(-1);        // The next line of the dump (-1 when not dumping)
+int dumpNewest;
+
+// CRC-8 (polynomial 0x31), as in the journal.  Starting at 0xFF means an erased (all 0)
+// record isn't valid.
+uint8_t crc8(const uint8_t *p, int length)
+{
+	uint8_t crc(0xFF);
+
+	while ( length-- )
+	{
+		crc ^= *p++;
+
+		for ( int i = 0; i < 8; ++i )
+			crc = crc & 0x80 ? (crc << 1) ^ 0x31 : crc << 1;
+	}
+
+	return crc;
+}
+
+int runAddress(int slot)
+{
+	return HISTORY_START + slot * sizeof(Run);
+}
+
+int statsAddress(int profile)
+{
+	return STATS_START + profile * sizeof(ProfileStats);
+}
+
+bool readRun(int slot, Run &r)
+{
+	EEPROM.get(runAddress(slot), r);
+
+	return r.number && r.crc == crc8((const uint8_t *) &r, sizeof(r) - 1);
+}
+
+// The slot with the newest run (-1 if there are none)
+int newestSlot(void)
+{
+	Run r;
+	int newest(-1);
+	uint16_t newestNumber(0);
+
+	for ( int slot = 0; slot < NO_OF_RUNS; ++slot )
+	{
+		if ( readRun(slot, r) && r.number > newestNumber )
+		{
+			newest = slot;
+			newestNumber = r.number;
+		}
+	}
+
+	return newest;
+}
+
+// Empty statistics if they have never been written (or are corrupt)
+void readStats(int profile, ProfileStats &s)
+{
+	EEPROM.get(statsAddress(profile), s);
+
+	if ( s.crc != crc8((const uint8_t *) &s, sizeof(s) - 1) )
+		memset(&s, 0, sizeof(s));
+}
+
+// Add a run to the mean and variance (count has already been incremented)
+void addSample(ProfileStats &s, int stat, long x)
+{
+	x = constrain(x, 0L, (long) STATS_MAX) * STATS_SCALE;
+
+	const long delta(x - s.mean[stat]);
+
+	s.mean[stat] += delta / (long) s.count;
+	s.variance[stat] += (delta * (x - s.mean[stat]) / STATS_SCALE - s.variance[stat]) / (long) s.count;
+}
+
+void updateStats(void)
+{
+	if ( run.kind != History::REFLOW || run.result != History::COMPLETED || run.variant >= STATS_PROFILES )
+		return;
+
+	ProfileStats s;
+
+	readStats(run.variant, s);
+
+	if ( s.count < STATS_WINDOW )
+		++s.count;
+
+	addSample(s, STAT_PEAK, run.peak);
+
+	for ( int i = 0; i < 3; ++i )
+		addSample(s, STAT_PRESOAK + i, run.phaseSeconds[i]);
+
+	addSample(s, STAT_ABOVE_LIQUIDUS, run.aboveSeconds);
+	s.crc = crc8((const uint8_t *) &s, sizeof(s) - 1);
+	EEPROM.put(statsAddress(run.variant), s);
+}
+
+unsigned int squareRoot(unsigned long x)
+{
+	unsigned long root(0), bit(1UL << 30);
+
+	while ( bit > x )
+		bit >>= 2;
+
+	for ( ; bit; bit >>= 2 )
+	{
+		// Each step decides one bit of the root
+		if ( x >= root + bit )
+		{
+			x -= root + bit;
+			root = (root >> 1) + bit;
+		}
+		else
+			root >>= 1;
+	}
+
+	return root;
+}
+
+void printRun(const Run &r)
+{
+	serialLog.print(F("Run "));
+	serialLog.print(r.number);
+	serialLog.print(F(": "));
+
+	switch ( r.kind )
+	{
+	case History::REFLOW:
+		serialLog.print(F("Reflow "));
+
+		if ( r.variant < ReflowProfile::count() )
+			serialLog.print(ReflowProfile::name(r.variant));
+		break;
+
+	case History::DRY:
+		if ( r.variant < DryingPresets::count() )
+		{
+			DryingPreset p;
+
+			DryingPresets::get(r.variant, p);
+			serialLog.print(p.name);
+			break;
+		}
+		// Fall through ...
+
+	default:
+		serialLog.print(F("Bake"));
+		break;
+	}
+
+	serialLog.print(F(", "));
+
+	if ( r.result < History::RESULTS )
+		serialLog.print((const __FlashStringHelper *) pgm_read_ptr(&resultDesc[r.result]));
+
+	serialLog.print(F(".  Phases"));
+
+	for ( int i = 0; i < History::PHASES; ++i )
+	{
+		serialLog.print(' ');
+		serialLog.print(r.phaseSeconds[i]);
+	}
+
+	serialLog.print(F("s, peak "));
+	printTemp(serialLog, r.peak);
+	serialLog.print('C');
+
+	if ( r.kind == History::REFLOW )
+	{
+		serialLog.print(F(", "));
+		serialLog.print(r.aboveSeconds);
+		serialLog.print(F("s above liquidus, adjusted"));
+
+		for ( int i = 0; i < 3; ++i )
+		{
+			serialLog.print(' ');
+			serialLog.print(r.adjustments[i]);
+		}
+	}
+
+	serialLog.print(F(", faults "));
+	serialLog.print(r.faults);
+	serialLog.print(F(", spikes "));
+	serialLog.println(r.spikes);
+}
+
+// The mean and standard deviation.  The peak is in quarter degrees, the rest in seconds.
+void printStat(const ProfileStats &s, int stat)
+{
+	// The square root of the scaled variance is the deviation * 4
+	const unsigned int deviation((squareRoot(s.variance[stat] > 0 ? s.variance[stat] : 0) + 2) / 4);
+	const long mean((s.mean[stat] + STATS_SCALE / 2) / STATS_SCALE);
+
+	serialLog.print((const __FlashStringHelper *) pgm_read_ptr(&statDesc[stat]));
+
+	if ( stat == STAT_PEAK )
+	{
+		printTemp(serialLog, mean);
+		serialLog.print(F("C sd "));
+		printTemp(serialLog, deviation);
+		serialLog.println('C');
+	}
+	else
+	{
+		serialLog.print(mean);
+		serialLog.print(F("s sd "));
+		serialLog.print(deviation);
+		serialLog.println('s');
+	}
+}
+
+} // namespace
+
+void History::start(int kind, int variant, int liquidus)
+{
+	memset(&run, 0, sizeof(run));
+	run.kind = kind;
+	run.variant = variant;
+	run.peak = TEMP_FAULT;
+	liquidusTemp = TEMP_C(liquidus);
+	ThermocoupleStats::counts(startFaults, startSpikes);
+	isRunning = true;
+	isEnded = false;
+	Trace::start();
+}
+
+void History::sample(int temp)
+{
+	if ( ! isRunning )
+		return;
+
+	if ( run.peak == TEMP_FAULT || temp > run.peak )
+		run.peak = temp;
+
+	if ( liquidusTemp && temp >= liquidusTemp )
+		++run.aboveSeconds;
+
+	// The trace of a reflow stops once it has cooled below liquidus, so the part that matters
+	// is recorded more finely
+	if ( run.aboveSeconds && temp < liquidusTemp - TEMP_C(5) )
+		Trace::stop();
+
+	Trace::sample(temp);
+}
+
+void History::phaseDone(int phase, unsigned long seconds)
+{
+	if ( isRunning && phase < PHASES )
+		run.phaseSeconds[phase] = seconds < 0xFFFF ? seconds : 0xFFFF;
+}
+
+// phase 0 is the presoak
+void History::adjusted(int phase, int adjustment)
+{
+	if ( isRunning && phase < 3 )
+		run.adjustments[phase] = constrain(run.adjustments[phase] + adjustment, -128, 127);
+}
+
+void History::end(int result)
+{
+	if ( ! isRunning )
+		return;
+
+	uint16_t faults, spikes;
+
+	// (The counts may have been reset with the "T" command since the run started)
+	ThermocoupleStats::counts(faults, spikes);
+	run.faults = faults >= startFaults ? faults - startFaults : faults;
+	spikes = spikes >= startSpikes ? spikes - startSpikes : spikes;
+	run.spikes = spikes < 0xFF ? spikes : 0xFF;
+	run.result = result;
+
+	if ( run.peak == TEMP_FAULT )
+		run.peak = 0;
+
+	isRunning = false;
+	isEnded = true;
+	Trace::stop();
+}
+
+// Write the run that has ended, in the slot after the newest
+void History::flush(void)
+{
+	if ( ! isEnded )
+		return;
+
+	Run newest;
+	const int slot(newestSlot());
+
+	run.number = 1;
+
+	if ( slot >= 0 && readRun(slot, newest) )
+		run.number = newest.number + 1;
+
+	run.crc = crc8((const uint8_t *) &run, sizeof(run) - 1);
+	EEPROM.put(runAddress((slot + 1) % NO_OF_RUNS), run);
+
+	updateStats();
+	Trace::save(run.number);
+	isEnded = false;
+}
+
+// Forget the runs, the statistics and the trace (changing the CRC of the ones that are valid)
+void History::clear(void)
+{
+	Run r;
+	ProfileStats s;
+
+	for ( int slot = 0; slot < NO_OF_RUNS; ++slot )
+	{
+		if ( readRun(slot, r) )
+			EEPROM.write(runAddress(slot) + sizeof(r) - 1, ~r.crc);
+	}
+
+	for ( int profile = 0; profile < STATS_PROFILES; ++profile )
+	{
+		EEPROM.get(statsAddress(profile), s);
+
+		if ( s.crc == crc8((const uint8_t *) &s, sizeof(s) - 1) )
+			EEPROM.write(statsAddress(profile) + sizeof(s) - 1, ~s.crc);
+	}
+	Trace::clear();
+}
+
+// Show the runs, oldest first, then the statistics for each profile that has some.  It is
+// sent a line per main loop (see dumpNext), so it doesn't overflow the serial log.
+void History::dump(void)
+{
+	dumpItem = 0;
+	dumpNewest = newestSlot();
+}
+
+void History::dumpNext(void)
+{
+	if ( dumpItem < 0 || serialLog.space() < DUMP_LINE_SIZE )
+		return;
+
+	const int item(dumpItem++);
+
+	if ( item == 0 )
+	{
+		serialLog.println(F("Run history:"));
+		return;
+	}
+
+	// Then a run from each slot
+	if ( item <= NO_OF_RUNS )
+	{
+		Run r;
+
+		if ( dumpNewest >= 0 && readRun((dumpNewest + item) % NO_OF_RUNS, r) )
+			printRun(r);
+		return;
+	}
+
+	// Then a heading and a line for each statistic, for each profile
+	const int profile((item - NO_OF_RUNS - 1) / (NO_OF_STATS + 1));
+	const int line((item - NO_OF_RUNS - 1) % (NO_OF_STATS + 1));
+
+	if ( profile >= STATS_PROFILES || profile >= ReflowProfile::count() )
+	{
+		dumpItem = -1;
+		return;
+	}
+
+	ProfileStats s;
+
+	readStats(profile, s);
+
+	if ( ! s.count )
+		return;
+
+	if ( line == 0 )
+	{
+		serialLog.print(ReflowProfile::name(profile));
+		serialLog.print(F(" (last "));
+		serialLog.print(s.count);
+		serialLog.println(F(" completed runs):"));
+	}
+	else
+		printStat(s, line - 1);
+}
@@ -0,0 +1,268 @@
+// EEPROM journal
+// The learned duty cycles change at the end of most reflows.  Written in place, the same few
+// EEPROM cells would take every write, and a cell is only good for about 100,000 writes.
+// Instead, blocks of data (like a profile's learning mode and duty cycles) are written as
+// records to a ring at the end of the EEPROM.  Each record goes in the next free slot, so the
+// writes are spread over the whole ring.
+//
+// A record is a sequence number, the block number, the data and a CRC.  At power on, the
+// ring is scanned for the newest valid record of each block.  A record that was only partly
+// written (the power went off) isn't valid, so the one before it is used instead.
+//
+// The slot holding the latest copy of a block is never reused, so there is always a good
+// copy while the next one is being written.  There are fewer blocks than slots, so there is
+// always a free slot.
+//
+// The sequence number goes up by one with every record and wraps at 256.  As long as every
+// record is less than 128 records old, the newest is the one furthest ahead of the others.
+// So a block that hasn't changed for a while is written again (refreshed) before it gets
+// that old.
+//
+// A record can also be written in the background, a byte at a time (post and writeBehind),
+// so a running mode doesn't wait for the EEPROM.  The block number is cleared first and
+// written last, so a record is never valid until all of it is there.  (The CRC alone would
+// pass 1 in 256 records that were only partly written.)
+
+#include <Arduino.h>
+#include <EEPROM.h>
+#include "ReflowWizard.h"
+
+namespace {
+
+#define JOURNAL_START  768 // The ring takes the last 256 bytes of EEPROM
+#define NO_OF_SLOTS     16
+#define NO_SLOT       0xFF
+#define NO_BLOCK      0xFF
+#define MAX_AGE         64 // Refresh a block once it is this many records old
+
+struct Record
+{
+	uint8_t sequence;
+	uint8_t block;
+	uint8_t data[Journal::DATA_SIZE];
+	uint8_t crc;       // Of everything before it
+};
+
+uint8_t liveSlot[Journal::MAX_BLOCKS]; // Where the latest copy of each block is
+uint8_t liveSequence[Journal::MAX_BLOCKS];
+uint8_t newestSlot(NO_SLOT);
+uint8_t nextSequence;
+
+// The record being written in the background
+Record pending;
+uint8_t pendingSlot(NO_SLOT);
+uint8_t pendingByte;
+
+// The block to write after it
+Record queued;
+bool isQueued;
+
+// CRC-8 (polynomial 0x31).  Starting at 0xFF means an erased (all 0) record isn't valid.
+uint8_t crc8(const uint8_t *p, int length)
+{
+	uint8_t crc(0xFF);
+
+	while ( length-- )
+	{
+		crc ^= *p++;
+
+		for ( int i = 0; i < 8; ++i )
+			crc = crc & 0x80 ? (crc << 1) ^ 0x31 : crc << 1;
+	}
+
+	return crc;
+}
+
+int slotAddress(int slot)
+{
+	return JOURNAL_START + slot * sizeof(Record);
+}
+
+bool readRecord(int slot, Record &r)
+{
+	EEPROM.get(slotAddress(slot), r);
+
+	return r.block < Journal::MAX_BLOCKS && r.crc == crc8((const uint8_t *) &r, sizeof(r) - 1);
+}
+
+bool isLive(int slot)
+{
+	for ( int block = 0; block < Journal::MAX_BLOCKS; ++block )
+	{
+		if ( liveSlot[block] == slot )
+			return true;
+	}
+
+	return false;
+}
+
+// Start on the next record: a block that needs refreshing, otherwise the queued one
+void startRecord(void)
+{
+	bool refresh(false);
+
+	for ( int block = 0; block < Journal::MAX_BLOCKS && ! refresh; ++block )
+	{
+		if ( liveSlot[block] != NO_SLOT && (uint8_t) (nextSequence - liveSequence[block]) >= MAX_AGE )
+			refresh = readRecord(liveSlot[block], pending);
+	}
+
+	if ( ! refresh )
+	{
+		pending = queued;
+		isQueued = false;
+	}
+
+	// The next slot after the newest record that isn't the latest copy of a block
+	int slot(newestSlot == NO_SLOT ? NO_OF_SLOTS - 1 : newestSlot);
+
+	do
+		slot = (slot + 1) % NO_OF_SLOTS;
+	while ( isLive(slot) );
+
+	pending.sequence = nextSequence++;
+	pending.crc = crc8((const uint8_t *) &pending, sizeof(pending) - 1);
+	pendingSlot = slot;
+	pendingByte = 0;
+}
+
+} // namespace
+
+void Journal::begin(void)
+{
+	Record r;
+	uint8_t newestSequence(0);
+
+	memset(liveSlot, NO_SLOT, sizeof(liveSlot));
+	newestSlot = NO_SLOT;
+	pendingSlot = NO_SLOT;
+	isQueued = false;
+
+	for ( int slot = 0; slot < NO_OF_SLOTS; ++slot )
+	{
+		if ( readRecord(slot, r)
+				&& (newestSlot == NO_SLOT || (int8_t) (r.sequence - newestSequence) > 0) )
+		{
+			newestSlot = slot;
+			newestSequence = r.sequence;
+		}
+	}
+
+	// The latest copy of each block is the one closest behind the newest record
+	for ( int slot = 0; slot < NO_OF_SLOTS; ++slot )
+	{
+		if ( ! readRecord(slot, r) )
+			continue;
+
+		if ( liveSlot[r.block] == NO_SLOT
+				|| (uint8_t) (newestSequence - r.sequence) < (uint8_t) (newestSequence - liveSequence[r.block]) )
+		{
+			liveSlot[r.block] = slot;
+			liveSequence[r.block] = r.sequence;
+		}
+	}
+
+	nextSequence = newestSequence + 1;
+}
+
+bool Journal::read(int block, uint8_t *data)
+{
+	Record r;
+
+	if ( liveSlot[block] == NO_SLOT || ! readRecord(liveSlot[block], r) )
+		return false;
+
+	memcpy(data, r.data, DATA_SIZE);
+	return true;
+}
+
+// Make every record invalid, by changing the CRC of the ones that are valid
+void Journal::clear(void)
+{
+	Record r;
+
+	for ( int slot = 0; slot < NO_OF_SLOTS; ++slot )
+	{
+		if ( readRecord(slot, r) )
+			EEPROM.write(slotAddress(slot) + sizeof(r) - 1, ~r.crc);
+	}
+
+	begin();
+}
+
+// Write the block in the background (see writeBehind).  A newer post of the same block
+// replaces one that is still waiting.  A different block waiting is written first (waiting
+// for the EEPROM).
+void Journal::post(int block, const uint8_t *data)
+{
+	if ( isQueued && queued.block != block )
+	{
+		while ( writeBehind() )
+			;
+	}
+
+	queued.block = block;
+	memcpy(queued.data, data, DATA_SIZE);
+	isQueued = true;
+}
+
+// Write the next byte of a posted block.  Call it when the EEPROM is ready, unless waiting
+// is OK.  Returns false when there is nothing left to write.
+bool Journal::writeBehind(void)
+{
+	if ( pendingSlot == NO_SLOT )
+	{
+		if ( ! isQueued )
+			return false;
+
+		startRecord();
+	}
+
+	// Clear the block number, then write the sequence number, data and CRC, then the block number
+	const int blockOffset(offsetof(Record, block));
+	int offset(pendingByte);
+	uint8_t value;
+
+	if ( pendingByte == 0 || pendingByte == sizeof(pending) )
+	{
+		offset = blockOffset;
+		value = pendingByte ? pending.block : NO_BLOCK;
+	}
+	else
+	{
+		if ( offset == blockOffset )
+			offset = offsetof(Record, sequence);
+
+		value = ((const uint8_t *) &pending)[offset];
+	}
+
+	EEPROM.update(slotAddress(pendingSlot) + offset, value);
+
+	if ( ++pendingByte > sizeof(pending) )
+	{
+		liveSlot[pending.block] = pendingSlot;
+		liveSequence[pending.block] = pending.sequence;
+		newestSlot = pendingSlot;
+		pendingSlot = NO_SLOT;
+	}
+
+	return true;
+}
+
+// Waits for the EEPROM, so only call this when nothing is running
+void Journal::write(int block, const uint8_t *data)
+{
+	uint8_t latest[DATA_SIZE];
+
+	while ( writeBehind() )
+		;
+
+	// Nothing to do if the latest copy is the same
+	if ( read(block, latest) && ! memcmp(latest, data, DATA_SIZE) )
+		return;
+
+	post(block, data);
+
+	while ( writeBehind() )
+		;
+}
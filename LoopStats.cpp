@@ -0,0 +1,87 @@
+// Main loop timing statistics
+// The control task (see Scheduler.cpp) is meant to run every 50ms.  Anything that takes
+// longer (delays, LCD and serial writes) makes it slip, and then the next one runs straight
+// away to catch up.  That distorts the element duty cycles.
+//
+// The time spent working in each control task is measured with micros() and counted
+// in a histogram with power-of-2 buckets.  This is cheap enough to leave enabled.
+
+#include <Arduino.h>
+#include "ReflowWizard.h"
+
+#define FIRST_BUCKET_SHIFT 7 // The first bucket holds iterations shorter than 128us
+
+namespace {
+
+uint32_t iterations;
+uint32_t overruns;   // Iterations that took longer than LOOP_INTERVAL
+uint32_t catchUps;   // Iterations that ended after the next one was due
+uint32_t maxMicros;
+uint32_t buckets[LoopStats::NO_OF_BUCKETS];
+
+} // namespace
+
+void LoopStats::record(uint32_t workMicros, bool behind)
+{
+	++iterations;
+
+	if ( workMicros > maxMicros )
+		maxMicros = workMicros;
+
+	if ( workMicros > LOOP_INTERVAL * 1000UL )
+		++overruns;
+
+	if ( behind )
+		++catchUps;
+
+	// Find the bucket (log2 of the duration)
+	int bucket(0);
+
+	for ( uint32_t t = workMicros >> FIRST_BUCKET_SHIFT; t && bucket < NO_OF_BUCKETS - 1; t >>= 1 )
+		++bucket;
+
+	++buckets[bucket];
+}
+
+void LoopStats::reset(void)
+{
+	iterations = 0;
+	overruns = 0;
+	catchUps = 0;
+	maxMicros = 0;
+
+	for ( int i = 0; i < NO_OF_BUCKETS; ++i )
+		buckets[i] = 0;
+}
+
+void LoopStats::dump(void)
+{
+	serialLog.print(F("Loop: iterations="));
+	serialLog.print(iterations);
+	serialLog.print(F(" max="));
+	serialLog.print(maxMicros);
+	serialLog.print(F("us overruns="));
+	serialLog.print(overruns);
+	serialLog.print(F(" catch-ups="));
+	serialLog.println(catchUps);
+
+	for ( int i = 0; i < NO_OF_BUCKETS; ++i )
+	{
+		if ( ! buckets[i] )
+			continue;
+
+		if ( i < NO_OF_BUCKETS - 1 )
+		{
+			serialLog.print(F("  < "));
+			serialLog.print(1UL << (FIRST_BUCKET_SHIFT + i));
+		}
+		else
+		{
+			serialLog.print(F("  >="));
+			serialLog.print(1UL << (FIRST_BUCKET_SHIFT + i - 1));
+		}
+
+		serialLog.print(F("us: "));
+		serialLog.println(buckets[i]);
+	}
+}
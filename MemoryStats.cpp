@@ -0,0 +1,102 @@
+// RAM use
+// The ATmega32U4 has 2.5KB of RAM.  The globals (.data and .bss) sit at the bottom, the heap
+// after them and the stack grows down from the top.  There is nothing to stop the stack
+// running into the globals, so it is worth knowing how close it has come.
+//
+// Before main() runs, everything between the end of the globals and the top of RAM is
+// painted with a known value.  The stack overwrites the paint as it grows, so counting the
+// painted bytes that are left shows the most stack that has been used since power on.
+//
+// The host build has no AVR memory map, so it just says so.
+
+#include <Arduino.h>
+#include "ReflowWizard.h"
+
+#if defined(__AVR__)
+
+#define STACK_PAINT 0xC5
+
+extern uint8_t _end;      // The end of the globals (from the linker)
+extern uint8_t __stack;   // The top of RAM
+extern char *__brkval;    // The end of the heap (0 if malloc has never been used)
+
+// Runs from .init1, before the stack pointer is set up, so it can't use the stack (or r1)
+void paintStack(void) __attribute__((naked, used, section(".init1")));
+
+void paintStack(void)
+{
+	__asm volatile (
+		"    ldi r30, lo8(_end)\n"
+		"    ldi r31, hi8(_end)\n"
+		"    ldi r24, lo8(0xc5)\n" // STACK_PAINT
+		"    ldi r25, hi8(__stack)\n"
+		"    rjmp 2f\n"
+		"1:  st Z+, r24\n"
+		"2:  cpi r30, lo8(__stack)\n"
+		"    cpc r31, r25\n"
+		"    brlo 1b\n"
+		"    breq 1b\n"
+		::);
+}
+
+namespace {
+
+const uint8_t *heapEnd(void)
+{
+	return __brkval ? (const uint8_t *) __brkval : &_end;
+}
+
+} // namespace
+
+int MemoryStats::staticRam(void)
+{
+	return &_end - (const uint8_t *) RAMSTART;
+}
+
+int MemoryStats::neverUsed(void)
+{
+	const uint8_t *p(heapEnd());
+
+	while ( p <= &__stack && *p == STACK_PAINT )
+		++p;
+
+	return p - heapEnd();
+}
+
+int MemoryStats::stackMax(void)
+{
+	return &__stack - heapEnd() + 1 - neverUsed();
+}
+
+int MemoryStats::freeNow(void)
+{
+	uint8_t here;
+
+	return &here - heapEnd();
+}
+
+void MemoryStats::dump(void)
+{
+	serialLog.print(F("RAM: globals="));
+	serialLog.print(staticRam());
+	serialLog.print(F(" stack max="));
+	serialLog.print(stackMax());
+	serialLog.print(F(" never used="));
+	serialLog.print(neverUsed());
+	serialLog.print(F(" free now="));
+	serialLog.println(freeNow());
+}
+
+#else
+
+int MemoryStats::staticRam(void) { return 0; }
+int MemoryStats::neverUsed(void) { return 0; }
+int MemoryStats::stackMax(void) { return 0; }
+int MemoryStats::freeNow(void) { return 0; }
+
+void MemoryStats::dump(void)
+{
+	serialLog.println(F("RAM: not measured on the host"));
+}
+
+#endif
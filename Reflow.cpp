@@ -1,13 +1,32 @@
 // Reflow logic
 // Called from the main loop 20 times per second
 // This where the reflow logic is controlled
+//
+// By default each heating phase runs the outputs at the learned duty cycles until the
+// phase's end temp is reached.  With Settings::REFLOW_TRACKING set, the oven instead
+// follows a target curve:
+// - The curve is made from the phase table.  It starts at 50C and ramps to each phase's end
+//   temp, taking the middle of the phase's min and max durations.  Then it holds max temp.
+// - Every tick each heating element gets its learned duty cycle for the phase (the feed
+//   forward) plus a correction (the feedback) from the error between the target and the temp.
+// - The correction is P plus I.  I isn't integrated while every element is saturated in
+//   the direction the error would push it (anti-windup).
+// - Phases don't abort for being too fast or too slow.  At the end of each phase the learned
+//   duty cycles are moved half way towards what was actually used, for the next run.
 
 #include <Arduino.h>
 #include "ReflowWizard.h"
+#include "Coroutine.h"
+#include "TelemetryFormat.h"
 
 #define MILLIS_TO_SECONDS ((long) 1000)
 
-extern const char *outputDesc[];
+// Target curve tracking
+#define TRACK_START_TEMP  50 // The curve starts here (C), which is also when the reflow timer starts
+#define TRACK_KP          16 // Correction per degree of error, in 1/4ths of a percent
+#define TRACK_KI          20 // I term = sum of error (quarter degrees, every tick) / TRACK_KI / 100
+#define TRACK_I_LIMIT     40 // The most (in percent) the I term can correct by
+#define TRACK_ADAPT_MIN    2 // Only adjust the learned duty cycles if the average correction is at least this
 
 namespace {
 
@@ -30,71 +49,100 @@ struct phaseData
 #define PHASE_COOLING_BOARDS_OUT 6 // Boards can be removed. Remain in this state until another reflow can be started at 50C
 #define PHASE_ABORT_REFLOW       7 // The reflow was aborted or completed.
 
-const char NULL_STR[] = "";
-const char PRESOAK_STR[] = "Presoak";
-const char SOAK_STR[] = "Soak";
-const char REFLOW_STR[] = "Reflow";
-const char WAITING_STR[] = "Waiting";
-const char COOLING_STR[] = "Cooling";
-const char COOL_OPEN_DOOR_STR[] = "Cool - open door";
-const char ABORT_STR[] = "Abort";
+const char NULL_FSTR[] PROGMEM = "";
+const char PRESOAK_FSTR[] PROGMEM = "Presoak";
+const char SOAK_FSTR[] PROGMEM = "Soak";
+const char REFLOW_FSTR[] PROGMEM = "Reflow";
+const char WAITING_FSTR[] PROGMEM = "Waiting";
+const char COOLING_FSTR[] PROGMEM = "Cooling";
+const char COOL_OPEN_DOOR_FSTR[] PROGMEM = "Cool - open door";
+const char ABORT_FSTR[] PROGMEM = "Abort";
 
-const char *phaseDesc[] = {NULL_STR, PRESOAK_STR, SOAK_STR, REFLOW_STR, WAITING_STR, COOLING_STR, COOL_OPEN_DOOR_STR, ABORT_STR};
+const char *const phaseDesc[] PROGMEM = {NULL_FSTR, PRESOAK_FSTR, SOAK_FSTR, REFLOW_FSTR, WAITING_FSTR, COOLING_FSTR, COOL_OPEN_DOOR_FSTR, ABORT_FSTR};
 
 int reflowPhase(PHASE_INIT);
 int outputType[4];
-int maxTemp;
+int profile;     // See ReflowProfiles.cpp
+int waitingTime; // Seconds in PHASE_WAITING
 bool learningMode;
 phaseData phase[PHASE_REFLOW+1];
 unsigned long phaseStartTime;
 unsigned long reflowStartTime;
 int elementDutyCounter[4];
-int counter(0);
 bool firstTimeInPhase(true);
+Coroutine phaseCoroutine; // Lets a phase show a message for a while without blocking
+int coroutinePhase(PHASE_INIT);
+
+// Target curve tracking (Settings::REFLOW_TRACKING)
+bool trackingMode;
+int trajectoryTime[PHASE_REFLOW+1]; // Seconds from the start of the curve to the end of each phase
+int trajectoryTemp[PHASE_REFLOW+1]; // The temp (C) at the end of each phase
+unsigned long trackStartTime;
+int targetTemp;                     // Quarter degrees
+int trackP;                         // Percent
+long trackIntegral;                 // Sum of error (quarter degrees) every tick
+long trackCorrectionSum;            // Sum of the corrections in this phase, to adjust the learned duty cycles
+long trackTicks;
+int trackedDuty[4];                 // The duty cycles being used
+
+const __FlashStringHelper *phaseName(int phase)
+{
+	return (const __FlashStringHelper *) pgm_read_ptr(&phaseDesc[phase]);
+}
 
 // Print data about the phase to the serial port
 void serialDisplayPhaseData(int phase, struct phaseData *pd, int *outputType)
 {
-	char buf[80];
+	if ( Telemetry::isBinary() )
+	{
+		Telemetry::phase(phase, pd->endTemp, pd->phaseMinDuration, pd->phaseMaxDuration, pd->elementDutyCycle);
+		return;
+	}
 
-	snprintf(buf, sizeof(buf), "******* Phase: %s *******", phaseDesc[phase]);
-	Serial.println(buf);
+	serialLog.print(F("******* Phase: "));
+	serialLog.print(phaseName(phase));
+	serialLog.println(F(" *******"));
 
-	snprintf(buf, sizeof(buf), "Min duration = %d seconds", pd->phaseMinDuration);
-	Serial.println(buf);
+	serialLog.print(F("Min duration = "));
+	serialLog.print(pd->phaseMinDuration);
+	serialLog.println(F(" seconds"));
 
-	snprintf(buf, sizeof(buf), "Max duration = %d seconds", pd->phaseMaxDuration);
-	Serial.println(buf);
+	serialLog.print(F("Max duration = "));
+	serialLog.print(pd->phaseMaxDuration);
+	serialLog.println(F(" seconds"));
 
-	snprintf(buf, sizeof(buf), "End temp = %d Celsius", pd->endTemp);
-	Serial.println(buf);
+	serialLog.print(F("End temp = "));
+	serialLog.print(pd->endTemp);
+	serialLog.println(F(" Celsius"));
 
-	Serial.println(F("Duty cycles: "));
+	serialLog.println(F("Duty cycles: "));
 
 	for (int i = 0; i < 4; ++i )
 	{
-		snprintf(buf, sizeof(buf), "  D%d = %d  (%s)"
-				, i + 4
-				, pd->elementDutyCycle[i]
-				, outputDesc[outputType[i]]);
-		Serial.println(buf);
+		serialLog.print(F("  D"));
+		serialLog.print(i + 4);
+		serialLog.print(F(" = "));
+		serialLog.print(pd->elementDutyCycle[i]);
+		serialLog.print(F("  ("));
+		serialLog.print(outputName(outputType[i]));
+		serialLog.println(')');
 	}
 }
 
 void thermocoupleFault(int fault)
 {
 	lcdPrintLineF(0, F("Thermocouple err"));
-	Serial.print(F("Thermocouple Error: "));
+	serialLog.print(F("Thermocouple Error: "));
 
 	switch ( fault )
 	{
 	case 1:
 		lcdPrintLineF(1, F("Fault open"));
-		Serial.println(F("Fault open"));
+		serialLog.println(F("Fault open"));
 		break;
 	case 2:
 		lcdPrintLineF(1, F("Short to GND"));
-		Serial.println(F("Short to ground"));
+		serialLog.println(F("Short to ground"));
 		break;
 	case 3:
 		lcdPrintLineF(1, F("Short to VCC"));
@@ -102,36 +150,67 @@ void thermocoupleFault(int fault)
 	}
 
 	// Abort the reflow
-	Serial.println(F("Reflow aborted because of thermocouple error!"));
+	serialLog.println(F("Reflow aborted because of thermocouple error!"));
 	reflowPhase = PHASE_ABORT_REFLOW;
+	History::end(History::THERMOCOUPLE);
 }
 
 // Display the current temp to the LCD screen and print it to the serial port so it can be plotted
 void displayReflowTemp(unsigned long currentTime
 		, unsigned long startTime
 		, unsigned long phaseTime
-		, double temp)
+		, int temp)
 {
 	// Display the temp on the LCD screen
 	displayTemp(temp);
+	History::sample(temp);
+
+	if ( Telemetry::isBinary() )
+	{
+		const bool heating(reflowPhase <= PHASE_REFLOW);
+
+		// Only the heating phases have duty cycles
+		if ( trackingMode && heating )
+			Telemetry::sample(TELEMETRY_REFLOW, reflowPhase, temp, trackedDuty
+					, (currentTime - phaseTime) / MILLIS_TO_SECONDS
+					, targetTemp, trackP, trackIntegral / (TRACK_KI * 100));
+		else
+			Telemetry::sample(TELEMETRY_REFLOW, reflowPhase, temp
+					, heating ? phase[reflowPhase].elementDutyCycle : NULL
+					, (currentTime - phaseTime) / MILLIS_TO_SECONDS);
+		return;
+	}
 
 	// Write the time and temp to the serial port, for graphing or analysis on a PC
-	char buf[80];
+	serialLog.print((currentTime - startTime) / MILLIS_TO_SECONDS);
+	serialLog.print(F(", "));
+	serialLog.print((currentTime - phaseTime) / MILLIS_TO_SECONDS);
+	serialLog.print(F(", "));
+	printTemp(serialLog, temp);
+
+	// Add the target when following the curve
+	if ( trackingMode && reflowPhase <= PHASE_REFLOW )
+	{
+		serialLog.print(F(", "));
+		printTemp(serialLog, targetTemp);
+	}
 
-	snprintf(buf, sizeof(buf), "%ld, %ld, "
-			, (currentTime - startTime) / MILLIS_TO_SECONDS
-			, (currentTime - phaseTime) / MILLIS_TO_SECONDS);
-	Serial.print(buf);
-	Serial.println(temp);
+	serialLog.println();
 }
 
 // Displays a message like "Reflow:Too slow"
-void lcdPrintPhaseMessage(int phase, const char *str)
+void lcdPrintPhaseMessage(int phase, const __FlashStringHelper *fstr)
 {
-	if ( str && strlen(str) <= 8 )
+	const char *str((const char *) fstr);
+	const char *desc((const char *) phaseName(phase));
+
+	if ( strlen_P(desc) + 1 + strlen_P(str) <= 16 )
 	{
-		char buf[20];
-		snprintf(buf, sizeof(buf), "%s:%s", phaseDesc[phase], str);
+		char buf[17];
+
+		strcpy_P(buf, desc);
+		strcat(buf, ":");
+		strcat_P(buf, str);
 		lcdPrintLine(0, buf);
 	}
 }
@@ -139,25 +218,29 @@ void lcdPrintPhaseMessage(int phase, const char *str)
 // Convenience function to save flash and RAM space
 void displayAdjustmentsMadeContinue(bool willContinue)
 {
-	Serial.println(F("Adjustments have been made to duty cycles for this phase. "));
-	Serial.println(willContinue ? F("Continuing ...") : F("Aborting ..."));
+	serialLog.println(F("Adjustments have been made to duty cycles for this phase. "));
+	serialLog.println(willContinue ? F("Continuing ...") : F("Aborting ..."));
 }
 
 // Adjust the duty cycle for all elements by the given adjustment value
 void adjustPhaseDutyCycle(int phase, int adjustment)
 {
 	int newDutyCycle;
-	char buf[80];
 
-	snprintf(buf, sizeof(buf)
-			, "Adjusting duty cycles for %s phase by %d"
-			, phaseDesc[phase], adjustment);
-	Serial.println(buf);
+	History::adjusted(phase - PHASE_PRESOAK, adjustment);
+
+	if ( ! Telemetry::isBinary() )
+	{
+		serialLog.print(F("Adjusting duty cycles for "));
+		serialLog.print(phaseName(phase));
+		serialLog.print(F(" phase by "));
+		serialLog.println(adjustment);
+	}
 
 	// Loop through the 4 outputs
 	for ( int i = 0; i < 4; ++i )
 	{
-		int dutySetting(Settings::PRESOAK_D4_DUTY_CYCLE + ((phase-1) * 4) + i);
+		int dutySetting(ReflowProfile::dutyCycleSetting(profile, phase, i));
 		newDutyCycle = Settings::get(dutySetting) + adjustment;
 		newDutyCycle = constrain(newDutyCycle, 0, 100); // Duty cycle must be between 0 and 100%
 
@@ -166,15 +249,24 @@ void adjustPhaseDutyCycle(int phase, int adjustment)
 		case TYPE_BOOST_ELEMENT:
 			// To avoid overstressing the boost element (which is just a mold heater),
 			// don't allow more than a 60% duty cycle
-			newDutyCycle = constrain(newDutyCycle, 0, 60);
+			newDutyCycle = constrain(newDutyCycle, 0, BOOST_MAX_DUTY);
 			// Fall through ...
 		case TYPE_TOP_ELEMENT:
 		case TYPE_BOTTOM_ELEMENT:
-			snprintf(buf, sizeof(buf), "D%d (%s) changed from %d to %d"
-							, i + 4
-							, outputDesc[Settings::get(Settings::D4_TYPE + i)]
-							, Settings::get(dutySetting), newDutyCycle);
-			Serial.println(buf);
+			if ( Telemetry::isBinary() )
+				Telemetry::dutyChanged(phase, i, Settings::get(dutySetting), newDutyCycle);
+			else
+			{
+				serialLog.print('D');
+				serialLog.print(i + 4);
+				serialLog.print(F(" ("));
+				serialLog.print(outputName(Settings::get(Settings::D4_TYPE + i)));
+				serialLog.print(F(") changed from "));
+				serialLog.print(Settings::get(dutySetting));
+				serialLog.print(F(" to "));
+				serialLog.println(newDutyCycle);
+			}
+
 			Settings::set(dutySetting, newDutyCycle); // Save the new duty cycle
 			break;
 
@@ -185,24 +277,214 @@ void adjustPhaseDutyCycle(int phase, int adjustment)
 	}
 }
 
+// The target temp (quarter degrees) for the time since the curve started
+int trajectoryTarget(unsigned long elapsed)
+{
+	for ( int i = PHASE_PRESOAK; i <= PHASE_REFLOW; ++i )
+	{
+		const unsigned long endTime(trajectoryTime[i] * MILLIS_TO_SECONDS);
+
+		if ( elapsed < endTime )
+		{
+			const unsigned long startTime(trajectoryTime[i-1] * MILLIS_TO_SECONDS);
+			const long rise(TEMP_C((long) (trajectoryTemp[i] - trajectoryTemp[i-1])));
+
+			return TEMP_C(trajectoryTemp[i-1]) + rise * (long) (elapsed - startTime) / (long) (endTime - startTime);
+		}
+	}
+
+	return TEMP_C(trajectoryTemp[PHASE_REFLOW]);
+}
+
+void trackingInit(void)
+{
+	trajectoryTime[PHASE_INIT] = 0;
+	trajectoryTemp[PHASE_INIT] = TRACK_START_TEMP;
+
+	for ( int i = PHASE_PRESOAK; i <= PHASE_REFLOW; ++i )
+	{
+		trajectoryTime[i] = trajectoryTime[i-1] + (phase[i].phaseMinDuration + phase[i].phaseMaxDuration) / 2;
+		trajectoryTemp[i] = phase[i].endTemp;
+	}
+
+	trackStartTime = millis();
+	targetTemp = TEMP_C(TRACK_START_TEMP);
+	trackP = 0;
+	trackIntegral = 0;
+	trackCorrectionSum = 0;
+	trackTicks = 0;
+}
+
+// Work out trackedDuty from the learned duty cycles and a correction.  Returns true if every
+// heating element is saturated (all at their maximum if correction > 0, all off if < 0).
+bool applyCorrection(int correction)
+{
+	bool saturated(true);
+
+	for ( int i = 0; i < 4; ++i )
+	{
+		const int learned(phase[reflowPhase].elementDutyCycle[i]);
+
+		if ( ! isHeatingElement(outputType[i]) )
+		{
+			trackedDuty[i] = learned;
+			continue;
+		}
+
+		// Don't overstress the boost element (see adjustPhaseDutyCycle)
+		const int maxDuty(outputType[i] == TYPE_BOOST_ELEMENT ? BOOST_MAX_DUTY : 100);
+
+		trackedDuty[i] = constrain(learned + correction, 0, maxDuty);
+
+		if ( correction > 0 ? trackedDuty[i] < maxDuty : trackedDuty[i] > 0 )
+			saturated = false;
+	}
+
+	return saturated;
+}
+
+// Follow the target curve (called every tick in the heating phases)
+void trackTrajectory(const int currentTemp, const unsigned long currentTime)
+{
+	// The curve doesn't start until the oven reaches its start temp
+	if ( currentTemp < TEMP_C(TRACK_START_TEMP) )
+		trackStartTime = currentTime;
+
+	targetTemp = trajectoryTarget(currentTime - trackStartTime);
+
+	const int error(targetTemp - currentTemp);
+
+	trackP = error * TRACK_KP / (TEMP_SCALE * 4);
+
+	if ( ! applyCorrection(trackP + trackIntegral / (TRACK_KI * 100)) )
+	{
+		trackIntegral = constrain(trackIntegral + error
+			, -TRACK_I_LIMIT * TRACK_KI * 100L, TRACK_I_LIMIT * TRACK_KI * 100L);
+	}
+
+	const int correction(trackP + trackIntegral / (TRACK_KI * 100));
+
+	applyCorrection(correction);
+
+	// Getting up to the start temp doesn't say anything about the phase's duty cycles
+	if ( currentTemp >= TEMP_C(TRACK_START_TEMP) )
+	{
+		trackCorrectionSum += correction;
+		++trackTicks;
+	}
+}
+
+// Move the learned duty cycles for the phase that has just finished half way towards
+// what was used
+void trackingAdaptPhase(int phase)
+{
+	if ( ! trackTicks )
+		return;
+
+	const int average(trackCorrectionSum / trackTicks);
+
+	trackCorrectionSum = 0;
+	trackTicks = 0;
+
+	if ( abs(average) >= TRACK_ADAPT_MIN )
+	{
+		adjustPhaseDutyCycle(phase, average / 2);
+		serialLog.println(F("Duty cycles adjusted for future runs"));
+	}
+}
+
+// Scale the starting duty cycles of a phase's heating elements, keeping their proportions, so
+// together they give the power the oven model needs to ramp through the phase in the middle
+// of its min and max durations.  Full power is every heating element at its maximum.
+// Returns the power, for the next phase.
+int seedPhaseDutyCycles(int phaseNo, int previousPower)
+{
+	const int firstSetting(ReflowProfile::dutyCycleSetting(profile, phaseNo, 0));
+	long total(0), totalMax(0);
+
+	for ( int i = 0; i < 4; ++i )
+	{
+		if ( isHeatingElement(outputType[i]) )
+		{
+			total += Settings::get(firstSetting + i);
+			totalMax += outputType[i] == TYPE_BOOST_ELEMENT ? BOOST_MAX_DUTY : 100;
+		}
+	}
+
+	const phaseData &pd(phase[phaseNo]);
+	const int fromTemp(phaseNo == PHASE_PRESOAK ? TRACK_START_TEMP : phase[phaseNo-1].endTemp);
+	const long power(OvenModel::rampPower(fromTemp, pd.endTemp
+			, (pd.phaseMinDuration + pd.phaseMaxDuration) / 2, previousPower));
+
+	if ( ! total )
+		return power;
+
+	for ( int i = 0; i < 4; ++i )
+	{
+		if ( isHeatingElement(outputType[i]) )
+		{
+			const long duty(Settings::get(firstSetting + i) * power * totalMax / (100 * total));
+
+			Settings::set(firstSetting + i
+				, constrain(duty, 0L, outputType[i] == TYPE_BOOST_ELEMENT ? BOOST_MAX_DUTY : 100L));
+		}
+	}
+
+	return power;
+}
+
+// Has the profile got duty cycles yet?  (Every heating element is 0 in every phase if not)
+bool hasDutyCycles(void)
+{
+	for ( int i = PHASE_PRESOAK; i <= PHASE_REFLOW; ++i )
+	{
+		for ( int j = 0; j < 4; ++j )
+		{
+			if ( isHeatingElement(outputType[j]) && Settings::get(ReflowProfile::dutyCycleSetting(profile, i, j)) )
+				return true;
+		}
+	}
+
+	return false;
+}
+
+void clearOtherProfiles(void)
+{
+	for ( int p = 0; p < ReflowProfile::count(); ++p )
+	{
+		if ( p == profile )
+			continue;
+
+		Settings::set(ReflowProfile::learningSetting(p), true);
+
+		for ( int i = PHASE_PRESOAK; i <= PHASE_REFLOW; ++i )
+		{
+			for ( int j = 0; j < 4; ++j )
+				Settings::set(ReflowProfile::dutyCycleSetting(p, i, j), 0);
+		}
+	}
+}
+
 void abortReflow(void)
 {
 	reflowPhase = PHASE_ABORT_REFLOW;
 	lcdPrintLineF(0, F("Aborting reflow"));
 	lcdPrintLineF(1, F("Button pressed"));
-	Serial.println(F("Button pressed.  Aborting reflow ..."));
-	delay(2000);
+	serialLog.println(F("Button pressed.  Aborting reflow ..."));
+	History::end(History::BUTTON);
 }
 
-void phaseInit(int &elementDutyStart, const double currentTemp)
+void phaseInit(int &elementDutyStart, const int currentTemp)
 {
+	CO_BEGIN(phaseCoroutine);
+
 	// Make sure the oven is cool.  This makes for more predictable/reliable reflows and
 	// gives the SSR's time to cool down a bit.
-	if ( currentTemp > 50.0 )
+	if ( currentTemp > TEMP_C(50) )
 	{
 		lcdPrintLineF(0, F("Temp > 50\1C"));
 		lcdPrintLineF(1, F("Please wait..."));
-		Serial.println(F("Oven too hot to start reflow.  Please wait ..."));
+		serialLog.println(F("Oven too hot to start reflow.  Please wait ..."));
 
 		// Abort the reflow
 		reflowPhase = PHASE_ABORT_REFLOW;
@@ -213,20 +495,40 @@ void phaseInit(int &elementDutyStart, const double currentTemp)
 	for ( int i = 0; i < 4; ++i )
 		outputType[i] = Settings::get(Settings::D4_TYPE + i);
 
-	// Get the maximum temp
-	maxTemp = Settings::get(Settings::MAX_TEMP);
+	// Get the profile (the phase temps and durations)
+	profile = ReflowProfile::selected();
+	trackingMode = Settings::get(Settings::REFLOW_TRACKING);
+
+	for ( int i = PHASE_PRESOAK; i <= PHASE_REFLOW; ++i )
+		ReflowProfile::getPhase(profile, i, phase[i].endTemp, phase[i].phaseMinDuration, phase[i].phaseMaxDuration);
+
+	waitingTime = ReflowProfile::waitingSeconds(profile);
+
+	serialLog.print(F("Profile: "));
+	serialLog.println(ReflowProfile::name(profile));
 
-	// If the settings have changed then set up learning mode
-	if ( Settings::get(Settings::SETTINGS_CHANGED) == true )
+	// If the settings have changed (or this profile has never been used) then set up learning mode
+	if ( Settings::get(Settings::SETTINGS_CHANGED) == true || ! hasDutyCycles() )
 	{
-		Settings::set(Settings::SETTINGS_CHANGED, false);
 		// Tell the user that learning mode is being enabled
-		lcdPrintLineF(0, F("Settings changed"));
+		if ( Settings::get(Settings::SETTINGS_CHANGED) == true )
+		{
+			Settings::set(Settings::SETTINGS_CHANGED, false);
+			// The other profiles' duty cycles are out of date too.  They start over when next used.
+			clearOtherProfiles();
+			lcdPrintLineF(0, F("Settings changed"));
+			serialLog.println(F("Settings changed by user.  Reinitializing element duty cycles and enabling learning mode ..."));
+		}
+		else
+		{
+			lcdPrintLineF(0, F("New profile"));
+			serialLog.println(F("First run of this profile.  Initializing element duty cycles and enabling learning mode ..."));
+		}
+
 		lcdPrintLineF(1, F("Initializing..."));
-		Serial.println(F("Settings changed by user.  Reinitializing element duty cycles and enabling learning mode ..."));
 
 		// Turn learning mode on
-		Settings::set(Settings::LEARNING_MODE, true);
+		Settings::set(ReflowProfile::learningSetting(profile), true);
 		// Set the starting duty cycle for each output.  These settings are conservative
 		// because it is better to increase them each cycle rather than risk damage to
 		// the PCB or components
@@ -243,68 +545,62 @@ void phaseInit(int &elementDutyStart, const double currentTemp)
 			{
 			case TYPE_UNUSED:
 			case TYPE_COOLING_FAN:
-				Settings::set(Settings::PRESOAK_D4_DUTY_CYCLE + i, 0);
-				Settings::set(Settings::SOAK_D4_DUTY_CYCLE + i, 0);
-				Settings::set(Settings::REFLOW_D4_DUTY_CYCLE + i, 0);
+				Settings::set(ReflowProfile::dutyCycleSetting(profile, PHASE_PRESOAK, i), 0);
+				Settings::set(ReflowProfile::dutyCycleSetting(profile, PHASE_SOAK, i), 0);
+				Settings::set(ReflowProfile::dutyCycleSetting(profile, PHASE_REFLOW, i), 0);
 				break;
 			case TYPE_TOP_ELEMENT:
-				Settings::set(Settings::PRESOAK_D4_DUTY_CYCLE + i, 50);
-				Settings::set(Settings::SOAK_D4_DUTY_CYCLE + i, 40);
-				Settings::set(Settings::REFLOW_D4_DUTY_CYCLE + i, 50);
+				Settings::set(ReflowProfile::dutyCycleSetting(profile, PHASE_PRESOAK, i), 50);
+				Settings::set(ReflowProfile::dutyCycleSetting(profile, PHASE_SOAK, i), 40);
+				Settings::set(ReflowProfile::dutyCycleSetting(profile, PHASE_REFLOW, i), 50);
 				break;
 			case TYPE_BOTTOM_ELEMENT:
-				Settings::set(Settings::PRESOAK_D4_DUTY_CYCLE + i, 80);
-				Settings::set(Settings::SOAK_D4_DUTY_CYCLE + i, 70);
-				Settings::set(Settings::REFLOW_D4_DUTY_CYCLE + i, 80);
+				Settings::set(ReflowProfile::dutyCycleSetting(profile, PHASE_PRESOAK, i), 80);
+				Settings::set(ReflowProfile::dutyCycleSetting(profile, PHASE_SOAK, i), 70);
+				Settings::set(ReflowProfile::dutyCycleSetting(profile, PHASE_REFLOW, i), 80);
 				break;
 			case TYPE_BOOST_ELEMENT:
-				Settings::set(Settings::PRESOAK_D4_DUTY_CYCLE + i, 30);
-				Settings::set(Settings::SOAK_D4_DUTY_CYCLE + i, 35);
-				Settings::set(Settings::REFLOW_D4_DUTY_CYCLE + i, 50);
+				Settings::set(ReflowProfile::dutyCycleSetting(profile, PHASE_PRESOAK, i), 30);
+				Settings::set(ReflowProfile::dutyCycleSetting(profile, PHASE_SOAK, i), 35);
+				Settings::set(ReflowProfile::dutyCycleSetting(profile, PHASE_REFLOW, i), 50);
 				break;
 			case TYPE_CONVECTION_FAN:
-				Settings::set(Settings::PRESOAK_D4_DUTY_CYCLE + i, 100);
-				Settings::set(Settings::SOAK_D4_DUTY_CYCLE + i, 100);
-				Settings::set(Settings::REFLOW_D4_DUTY_CYCLE + i, 100);
+				Settings::set(ReflowProfile::dutyCycleSetting(profile, PHASE_PRESOAK, i), 100);
+				Settings::set(ReflowProfile::dutyCycleSetting(profile, PHASE_SOAK, i), 100);
+				Settings::set(ReflowProfile::dutyCycleSetting(profile, PHASE_REFLOW, i), 100);
 				break;
 			}
 		}
 
+		// If the oven has been autotuned, scale them to the power the model says is needed
+		if ( OvenModel::isValid() )
+		{
+			// The presoak starts with everything on (when not following the curve)
+			int power(trackingMode ? -1 : 100);
+
+			for ( int i = PHASE_PRESOAK; i <= PHASE_REFLOW; ++i )
+				power = seedPhaseDutyCycles(i, power);
+
+			serialLog.println(F("Duty cycles set from the autotuned oven model"));
+		}
+
 		// Wait a bit to allow the user to read the message
-		delay(3000);
+		CO_DELAY(phaseCoroutine, 3000);
 	} // end of settings changed
 
 	// Read all the settings
-	learningMode = Settings::get(Settings::LEARNING_MODE);
+	learningMode = Settings::get(ReflowProfile::learningSetting(profile));
 
 	for ( int i = PHASE_PRESOAK; i <= PHASE_REFLOW; ++i )
 	{
 		for ( int j = 0; j < 4; ++j )
-			phase[i].elementDutyCycle[j] = Settings::get(Settings::PRESOAK_D4_DUTY_CYCLE + ((i-PHASE_PRESOAK) *4) + j);
-
-		// Time to peak temp should be between 3.5 and 5.5 minutes.
-		// While J-STD-20 gives exact phase temps, the reading depends very much on the thermocouple used
-		// and its location.  Varying the phase temps as the max temp changes allows for thermocouple
-		// variation.
-		// Keep in mind that there is a 2C error in the MAX31855, and typically a 3C error in the thermocouple.
-		switch ( i )
-		{
-		case PHASE_PRESOAK:
-			phase[i].endTemp = maxTemp * 3 / 5; // J-STD-20 gives 150C
-			phase[i].phaseMinDuration = 60;
-			phase[i].phaseMaxDuration = 100;
-			break;
-		case PHASE_SOAK:
-			phase[i].endTemp = maxTemp * 4 / 5; // J-STD-20 gives 200C
-			phase[i].phaseMinDuration = 80;
-			phase[i].phaseMaxDuration = 140;
-			break;
-		case PHASE_REFLOW:
-			phase[i].endTemp = maxTemp;
-			phase[i].phaseMinDuration = 60;
-			phase[i].phaseMaxDuration = 100;
-			break;
-		}
+			phase[i].elementDutyCycle[j] = Settings::get(ReflowProfile::dutyCycleSetting(profile, i, j));
+	}
+
+	if ( trackingMode )
+	{
+		trackingInit();
+		serialLog.println(F("Following the target curve"));
 	}
 
 	// Let the user know if learning mode is on
@@ -312,13 +608,13 @@ void phaseInit(int &elementDutyStart, const double currentTemp)
 	{
 		lcdPrintLineF(0, F("Learning Mode"));
 		lcdPrintLineF(1, F("is enabled"));
-		Serial.println(F("Learning mode is enabled.  Duty cycles may be adjusted automatically if necessary"));
-		delay(3000);
+		serialLog.println(F("Learning mode is enabled.  Duty cycles may be adjusted automatically if necessary"));
+		CO_DELAY(phaseCoroutine, 3000);
 	}
 
 	// Move to the next phase
 	reflowPhase = PHASE_PRESOAK;
-	lcdPrintLine(0, phaseDesc[reflowPhase]);
+	lcdPrintLineF(0, phaseName(reflowPhase));
 	lcdPrintLine(1, "");
 
 	// Display information about this phase
@@ -340,21 +636,26 @@ void phaseInit(int &elementDutyStart, const double currentTemp)
 	// Start the reflow and phase timers
 	reflowStartTime = millis();
 	phaseStartTime = reflowStartTime;
+	History::start(History::REFLOW, profile, ReflowProfile::liquidus(profile));
+
+	CO_END(phaseCoroutine);
 }
 
-void phaseHeat(int &elementDutyStart, const double currentTemp, const unsigned long currentTime)
+void phaseHeat(int &elementDutyStart, const int currentTemp, const unsigned long currentTime)
 {
 	// Has the ending temp for this phase been reached?
-	if ( currentTemp >= phase[reflowPhase].endTemp )
+	if ( currentTemp >= TEMP_C(phase[reflowPhase].endTemp) )
 	{
+		// When following the curve the phase takes as long as the curve says, so there is no
+		// need to check the duration.  Learn from the corrections that were needed instead.
+		if ( trackingMode )
+			trackingAdaptPhase(reflowPhase);
 		// Was enough time spent in this phase?
-		if ( currentTime - phaseStartTime < (unsigned long) (phase[reflowPhase].phaseMinDuration * MILLIS_TO_SECONDS) )
+		else if ( currentTime - phaseStartTime < (unsigned long) (phase[reflowPhase].phaseMinDuration * MILLIS_TO_SECONDS) )
 		{
-			char buf[80];
-
-			snprintf(buf, sizeof(buf), "Warning: Oven heated up too quickly! Phase took %ld seconds."
-					, (currentTime - phaseStartTime) / MILLIS_TO_SECONDS);
-			Serial.println(buf);
+			serialLog.print(F("Warning: Oven heated up too quickly! Phase took "));
+			serialLog.print((currentTime - phaseStartTime) / MILLIS_TO_SECONDS);
+			serialLog.println(F(" seconds."));
 
 			// Too little time was spent in this phase
 			if ( learningMode )
@@ -372,9 +673,10 @@ void phaseHeat(int &elementDutyStart, const double currentTemp, const unsigned l
 					adjustPhaseDutyCycle(reflowPhase, -7);
 
 					// Abort this run
-					lcdPrintPhaseMessage(reflowPhase, "Too fast");
+					lcdPrintPhaseMessage(reflowPhase, F("Too fast"));
 					lcdPrintLineF(1, F("Aborting ..."));
 					reflowPhase = PHASE_ABORT_REFLOW;
+					History::end(History::TOO_FAST);
 
 					displayAdjustmentsMadeContinue(false);
 					return;
@@ -386,14 +688,15 @@ void phaseHeat(int &elementDutyStart, const double currentTemp, const unsigned l
 				// results.  However, this situation cannot be ignored.  Reduce the duty cycle slightly but
 				// don't abort the reflow
 				adjustPhaseDutyCycle(reflowPhase, -1);
-				Serial.println(F("Duty cycles lowered slightly for future runs"));
+				serialLog.println(F("Duty cycles lowered slightly for future runs"));
 			}
 		}
 
 		// The temp is high enough to move to the next phase
+		History::phaseDone(reflowPhase - PHASE_PRESOAK, (currentTime - phaseStartTime) / MILLIS_TO_SECONDS);
 		++reflowPhase;
 		firstTimeInPhase = true;
-		lcdPrintLine(0, phaseDesc[reflowPhase]);
+		lcdPrintLineF(0, phaseName(reflowPhase));
 		phaseStartTime = millis();
 
 		// Stagger the element start cycle to avoid abrupt changes in current draw
@@ -419,15 +722,16 @@ void phaseHeat(int &elementDutyStart, const double currentTemp, const unsigned l
 	// Has too much time been spent in this phase?
 	if ( currentTime - phaseStartTime > (unsigned long) (phase[reflowPhase].phaseMaxDuration * MILLIS_TO_SECONDS))
 	{
-		Serial.print(F("Warning: Oven heated up too slowly! Current temp is "));
-		Serial.println(currentTemp);
+		serialLog.print(F("Warning: Oven heated up too slowly! Current temp is "));
+		printTemp(serialLog, currentTemp);
+		serialLog.println();
 
-		// Still in learning mode?
-		if ( learningMode )
+		// Still in learning mode?  (The curve is already doing all it can when tracking.)
+		if ( learningMode && ! trackingMode )
 		{
-			double tempDelta(phase[reflowPhase].endTemp - currentTemp);
+			int tempDelta(TEMP_C(phase[reflowPhase].endTemp) - currentTemp);
 
-			if ( tempDelta <= 3 )
+			if ( tempDelta <= TEMP_C(3) )
 			{
 				// Almost made it!  Make a small adjustment to the duty cycles.  Continue with the reflow
 				adjustPhaseDutyCycle(reflowPhase, 4);
@@ -437,15 +741,16 @@ void phaseHeat(int &elementDutyStart, const double currentTemp, const unsigned l
 			else
 			{
 				// A more dramatic temp increase is needed for this phase
-				if ( tempDelta < 10 )
+				if ( tempDelta < TEMP_C(10) )
 					adjustPhaseDutyCycle(reflowPhase, 8);
 				else
 					adjustPhaseDutyCycle(reflowPhase, 15);
 
 				// Abort this run
-				lcdPrintPhaseMessage(reflowPhase, "Too slow");
+				lcdPrintPhaseMessage(reflowPhase, F("Too slow"));
 				lcdPrintLineF(1, F("Aborting ..."));
 				reflowPhase = PHASE_ABORT_REFLOW;
+				History::end(History::TOO_SLOW);
 				displayAdjustmentsMadeContinue(false);
 			}
 
@@ -459,16 +764,19 @@ void phaseHeat(int &elementDutyStart, const double currentTemp, const unsigned l
 			 * However, this situation cannot be ignored.
 			 * Increase the duty cycle slightly but don't abort the reflow
 			 */
-			adjustPhaseDutyCycle(reflowPhase, 1);
-			Serial.println(F("Duty cycles increased slightly for future runs"));
-
-			// Turn all the elements on to get to temp quickly
-			for (int i = 0; i < 4; ++i )
+			if ( ! trackingMode )
 			{
-				if ( outputType[i] == TYPE_TOP_ELEMENT
-						|| outputType[i] == TYPE_BOTTOM_ELEMENT
-						|| outputType[i] == TYPE_BOOST_ELEMENT )
-					phase[reflowPhase].elementDutyCycle[i] = 100;
+				adjustPhaseDutyCycle(reflowPhase, 1);
+				serialLog.println(F("Duty cycles increased slightly for future runs"));
+
+				// Turn all the elements on to get to temp quickly
+				for (int i = 0; i < 4; ++i )
+				{
+					if ( outputType[i] == TYPE_TOP_ELEMENT
+							|| outputType[i] == TYPE_BOTTOM_ELEMENT
+							|| outputType[i] == TYPE_BOOST_ELEMENT )
+						phase[reflowPhase].elementDutyCycle[i] = 100;
+				}
 			}
 
 			// Extend this phase by 5 seconds, or abort the reflow if it has taken too long
@@ -476,14 +784,20 @@ void phaseHeat(int &elementDutyStart, const double currentTemp, const unsigned l
 				phase[reflowPhase].phaseMaxDuration += 5;
 			else
 			{
-				lcdPrintPhaseMessage(reflowPhase, "Too slow");
+				lcdPrintPhaseMessage(reflowPhase, F("Too slow"));
 				lcdPrintLineF(1, F("Aborting ..."));
 				reflowPhase = PHASE_ABORT_REFLOW;
-				Serial.println(F("Aborting reflow.  Oven cannot reach required temp!"));
+				History::end(History::TOO_SLOW);
+				serialLog.println(F("Aborting reflow.  Oven cannot reach required temp!"));
 			}
 		}
 	}
 
+	if ( trackingMode )
+		trackTrajectory(currentTemp, currentTime);
+
+	const int *duty(trackingMode ? trackedDuty : phase[reflowPhase].elementDutyCycle);
+
 	// Turn the output on or off based on its duty cycle
 	for ( int i = 0; i < 4; ++i )
 	{
@@ -491,34 +805,31 @@ void phaseHeat(int &elementDutyStart, const double currentTemp, const unsigned l
 		if ( outputType[i] == TYPE_UNUSED || outputType[i] == TYPE_COOLING_FAN )
 			continue;
 
-		// Turn all the elements on at the start of the presoak
-		if ( reflowPhase == PHASE_PRESOAK && currentTemp < (phase[reflowPhase].endTemp * 3 / 5) )
+		// Turn all the elements on at the start of the presoak (the curve does this itself)
+		if ( ! trackingMode && reflowPhase == PHASE_PRESOAK && currentTemp < TEMP_C(phase[reflowPhase].endTemp * 3 / 5) )
 		{
 			digitalWrite(4 + i, HIGH);
 			continue;
 		}
 
-		// Turn the output on at 0, and off at the duty cycle value
-		if ( elementDutyCounter[i] == 0 )
-			digitalWrite(4 + i, HIGH);
-
-		if ( elementDutyCounter[i] == phase[reflowPhase].elementDutyCycle[i] )
-			digitalWrite(4 + i, LOW);
+		// On from 0 up to the duty cycle value.  Comparing (rather than switching at exactly
+		// 0 and the duty cycle) means the duty cycle can change at any time.
+		digitalWrite(4 + i, elementDutyCounter[i] < duty[i] ? HIGH : LOW);
 
 		// Increment the duty counter
 		elementDutyCounter[i] = (elementDutyCounter[i] + 1) % 100;
 	}
 
 	// Don't consider the reflow process started until the temp passes 50 degrees
-	if ( currentTemp < 50.0 )
+	if ( currentTemp < TEMP_C(50) )
 		phaseStartTime = currentTime;
 
 	// Update the displayed temp roughly once per second
-	if ( ! (counter++ % 20) )
+	if ( Scheduler::isNewSecond() )
 		displayReflowTemp(currentTime, reflowStartTime, phaseStartTime, currentTemp);
 }
 
-void phaseWaiting(const double currentTemp, const unsigned long currentTime)
+void phaseWaiting(const int currentTemp, const unsigned long currentTime)
 {
 	if ( firstTimeInPhase )
 	{
@@ -526,8 +837,8 @@ void phaseWaiting(const double currentTemp, const unsigned long currentTime)
 		// Update the display
 		lcdPrintLineF(0, F("Reflow"));
 		lcdPrintLine(1, " ");
-		Serial.println(F("******* Phase: Waiting *******"));
-		Serial.println(F("Turning all heating elements off ..."));
+		serialLog.println(F("******* Phase: Waiting *******"));
+		serialLog.println(F("Turning all heating elements off ..."));
 
 		// Make sure all the elements are off (keep convection fans on)
 		for ( int i = 0; i < 4; ++i )
@@ -537,37 +848,39 @@ void phaseWaiting(const double currentTemp, const unsigned long currentTime)
 		}
 
 		// If we made it here it means the reflow is within the defined parameters.  Turn off learning mode
-		Settings::set(Settings::LEARNING_MODE, false);
+		Settings::set(ReflowProfile::learningSetting(profile), false);
 	}
 
 	// Update the displayed temp roughly once per second
-	if ( ! (counter++ % 20) )
+	if ( Scheduler::isNewSecond() )
 	{
 		displayReflowTemp(currentTime, reflowStartTime, phaseStartTime, currentTemp);
 		// Countdown to the end of this phase
 		lcd.setCursor(13, 0);
-		lcd.print(40 - ((currentTime - phaseStartTime) / MILLIS_TO_SECONDS));
+		lcd.print(waitingTime - ((currentTime - phaseStartTime) / MILLIS_TO_SECONDS));
 		lcd.print("s ");
 	}
 
-	// Wait in this phase for 40 seconds.  The maximum time in liquidous state is 150 seconds
+	// Wait in this phase for the profile's time (40 seconds for the max temp profile).  The maximum
+	// time in liquidous state is 150 seconds
 	// Max 90 seconds in PHASE_REFLOW + 40 seconds in PHASE_WAITING + some cool down time in PHASE_COOLING_BOARDS_IN is less than 150 seconds.
-	if ( currentTime - phaseStartTime > 40 * MILLIS_TO_SECONDS )
+	if ( currentTime - phaseStartTime > (unsigned long) (waitingTime * MILLIS_TO_SECONDS) )
 	{
+		History::phaseDone(PHASE_WAITING - PHASE_PRESOAK, (currentTime - phaseStartTime) / MILLIS_TO_SECONDS);
 		reflowPhase = PHASE_COOLING_BOARDS_IN;
 		firstTimeInPhase = true;
 	}
 }
 
-void phaseCoolingBoardsIn(const double currentTemp, const unsigned long currentTime)
+void phaseCoolingBoardsIn(const int currentTemp, const unsigned long currentTime)
 {
 	if ( firstTimeInPhase )
 	{
 		firstTimeInPhase = false;
 		// Update the display
 		lcdPrintLineF(0, F("Cool - open door"));
-		Serial.println(F("******* Phase: Cooling *******"));
-		Serial.println(F("Open the oven door ..."));
+		serialLog.println(F("******* Phase: Cooling *******"));
+		serialLog.println(F("Open the oven door ..."));
 		// If a servo is attached, use it to open the door over 10 seconds
 		setServoPosition(Settings::get(Settings::SERVO_OPEN_DEGREES), 10000);
 		// Play a tune to let the user know the door should be opened
@@ -582,18 +895,18 @@ void phaseCoolingBoardsIn(const double currentTemp, const unsigned long currentT
 	}
 
 	// Update the temp roughly once per second
-	if ( ! (counter++ % 20) )
+	if ( Scheduler::isNewSecond() )
 		displayReflowTemp(currentTime, reflowStartTime, phaseStartTime, currentTemp);
 
 	// Boards can be removed once the temp drops below 100C
-	if ( currentTemp < 100.0 )
+	if ( currentTemp < TEMP_C(100) )
 	{
 		reflowPhase = PHASE_COOLING_BOARDS_OUT;
 		firstTimeInPhase = true;
 	}
 }
 
-void phaseCoolingBoardsOut(const double currentTemp, const unsigned long currentTime)
+void phaseCoolingBoardsOut(const int currentTemp, const unsigned long currentTime)
 {
 	if ( firstTimeInPhase )
 	{
@@ -606,13 +919,14 @@ void phaseCoolingBoardsOut(const double currentTemp, const unsigned long current
 	}
 
 	// Update the temp roughly once per second
-	if ( ! (counter++ % 20) )
+	if ( Scheduler::isNewSecond() )
 		displayReflowTemp(currentTime, reflowStartTime, phaseStartTime, currentTemp);
 
 	// Once the temp drops below 50C a new reflow can be started
-	if ( currentTemp < 50.0 )
+	if ( currentTemp < TEMP_C(50) )
 	{
 		reflowPhase = PHASE_ABORT_REFLOW;
+		History::end(History::COMPLETED);
 		lcdPrintLineF(0, F("Reflow complete!"));
 		lcdPrintLine(1, " ");
 	}
@@ -620,18 +934,23 @@ void phaseCoolingBoardsOut(const double currentTemp, const unsigned long current
 
 void phaseAbortReflow(void)
 {
-	Serial.println(F("Reflow is done!"));
+	CO_BEGIN(phaseCoroutine);
+
+	serialLog.println(F("Reflow is done!"));
 	// Turn all elements and fans off
 	for ( int i = 4; i < 8; ++i )
 		digitalWrite(i, LOW);
 
 	// Close the oven door now, over 3 seconds
 	setServoPosition(Settings::get(Settings::SERVO_CLOSED_DEGREES), 3000);
+
+	// Wait for a bit to allow the user to read the last message
+	CO_DELAY(phaseCoroutine, 3000);
+
 	// Start next time with initialization
 	reflowPhase = PHASE_INIT;
 
-	// Wait for a bit to allow the user to read the last message
-	delay(3000);
+	CO_END(phaseCoroutine);
 }
 
 // For debugging you can use this function to simulate the thermocouple
@@ -648,10 +967,10 @@ void phaseAbortReflow(void)
   if (bakeDutyCycle == 100)
     offset = 0.001;
   if ((++counter % 20000) == 0) {
-    Serial.print("Offset was ");
-    Serial.print(int (offset * 1000));
-    Serial.print("  Duty = ");
-    Serial.println(bakeDutyCycle);
+    serialLog.print("Offset was ");
+    serialLog.print(int (offset * 1000));
+    serialLog.print("  Duty = ");
+    serialLog.println(bakeDutyCycle);
     offset += 0.0005;
   }
 
@@ -675,15 +994,23 @@ void phaseAbortReflow(void)
 bool Reflow(void)
 {
 	const unsigned long currentTime(millis());
-	double currentTemp(0.0);
+	int currentTemp(0);
 	int fault(getCurrentTemp(currentTemp));
 
-	if ( fault )
+	// Once aborting, leave the message on the screen alone
+	if ( fault && reflowPhase != PHASE_ABORT_REFLOW )
 		thermocoupleFault(fault);
 
-	if ( getButton() != CONTROLEO_BUTTON_NONE )
+	if ( getButton() != CONTROLEO_BUTTON_NONE && reflowPhase != PHASE_ABORT_REFLOW )
 		abortReflow();
 
+	// A phase that was part way through showing a message starts from the top if the phase changed
+	if ( reflowPhase != coroutinePhase )
+	{
+		coroutinePhase = reflowPhase;
+		phaseCoroutine.reset();
+	}
+
 	int elementDutyStart(0);
 
 	switch ( reflowPhase )
@@ -712,7 +1039,11 @@ bool Reflow(void)
 
 	case PHASE_ABORT_REFLOW: // The reflow must be stopped now
 		phaseAbortReflow();
-		return false; // Return to the main menu
+
+		if ( reflowPhase == PHASE_INIT )
+			return false; // Return to the main menu
+
+		break;
 	}
 
 	return true;
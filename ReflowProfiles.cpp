@@ -0,0 +1,128 @@
+// Reflow profiles
+// The first profile is the original curve, based on the max temp setting.  The others are made
+// from solder paste parameters at compile time and kept in flash.  The profile is chosen in
+// the Setup menu (Settings::REFLOW_PROFILE).
+//
+// Each profile learns its own duty cycles, so switching paste doesn't start learning over.
+// The first profile keeps its learning mode and duty cycles in the original settings
+// (LEARNING_MODE to REFLOW_D7_DUTY_CYCLE).  The others have a block of the same layout each,
+// from Settings::PROFILE_LEARNING_MODE.  Settings.cpp keeps the learning in the journal.
+
+#include <Arduino.h>
+#include "ReflowWizard.h"
+
+namespace {
+
+#define START_TEMP        50 // The reflow timer starts at 50C (see phaseHeat)
+#define SOAK_MIN_SECONDS  60 // J-STD-020 preheat (soak) time
+#define SOAK_MAX_SECONDS 120
+#define COOL_RATE          3 // C per second with the door open
+
+struct ProfileData
+{
+	char name[17];
+	int16_t endTemp[3];     // Presoak, soak and reflow
+	int16_t minDuration[3]; // Seconds
+	int16_t maxDuration[3];
+	int16_t waiting;        // Seconds in the waiting phase
+	int16_t liquidus;       // For the time above liquidus in the run history
+};
+
+// A profile from a solder paste's parameters (C, seconds and C per second):
+// - Presoak ramps from 50C to the start of the soak, between the ramp limits
+// - Soak ramps through the soak temps in the J-STD-020 time
+// - Reflow ramps to the peak, between the ramp limits
+// - Waiting makes up the time above liquidus, less the time spent above it getting to the peak
+//   (at the average ramp) and cooling back down
+#define PASTE(name, soakStart, soakEnd, liquidus, peak, timeAboveLiquidus, rampMin, rampMax) \
+	{ name \
+	, { soakStart, soakEnd, peak } \
+	, { (soakStart - START_TEMP) / rampMax, SOAK_MIN_SECONDS, (peak - soakEnd) / rampMax } \
+	, { (soakStart - START_TEMP) / rampMin, SOAK_MAX_SECONDS, (peak - soakEnd) / rampMin } \
+	, timeAboveLiquidus - (peak - liquidus) * 2 / (rampMin + rampMax) - (peak - liquidus) / COOL_RATE \
+	, liquidus }
+
+const ProfileData profiles[] PROGMEM = {
+	// The first profile's temps are worked out from the max temp setting (see getPhase).  Its
+	// default max temp (240C) is for lead-free paste.
+	{ "Max temp", { 0, 0, 0 }, { 60, 80, 60 }, { 100, 140, 100 }, 40, 217 }
+	//     Name                Soak      Liquidus Peak  TAL  Ramp
+	, PASTE("Lead-free SAC305", 150, 200, 217,    245,  60,  1, 3)
+	, PASTE("Leaded Sn63Pb37",  100, 150, 183,    215,  60,  1, 3)
+	, PASTE("Bismuth Sn42Bi58",  90, 120, 138,    165,  60,  1, 3)
+};
+
+#define NO_OF_PROFILES ((int) (sizeof(profiles) / sizeof(profiles[0])))
+
+int get16(const int16_t *p)
+{
+	return (int16_t) pgm_read_word(p);
+}
+
+} // namespace
+
+int ReflowProfile::count(void)
+{
+	return NO_OF_PROFILES;
+}
+
+int ReflowProfile::selected(void)
+{
+	const int profile(Settings::get(Settings::REFLOW_PROFILE));
+
+	return profile < NO_OF_PROFILES ? profile : 0;
+}
+
+const __FlashStringHelper *ReflowProfile::name(int profile)
+{
+	return (const __FlashStringHelper *) profiles[profile].name;
+}
+
+// The setting holding the profile's learning mode.  Its duty cycles follow, like
+// Settings::LEARNING_MODE and PRESOAK_D4_DUTY_CYCLE.
+int ReflowProfile::learningSetting(int profile)
+{
+	if ( profile == 0 )
+		return Settings::LEARNING_MODE;
+
+	return Settings::PROFILE_LEARNING_MODE + (profile - 1) * LEARNING_SETTINGS;
+}
+
+// phase is 1 (presoak) to 3 (reflow), output is 0 (D4) to 3 (D7)
+int ReflowProfile::dutyCycleSetting(int profile, int phase, int output)
+{
+	return learningSetting(profile) + 1 + (phase - 1) * 4 + output;
+}
+
+void ReflowProfile::getPhase(int profile, int phase, int &endTemp, int &minDuration, int &maxDuration)
+{
+	const ProfileData &p(profiles[profile]);
+
+	if ( profile == 0 )
+	{
+		// Time to peak temp should be between 3.5 and 5.5 minutes.
+		// While J-STD-20 gives exact phase temps, the reading depends very much on the thermocouple used
+		// and its location.  Varying the phase temps as the max temp changes allows for thermocouple
+		// variation.
+		// Keep in mind that there is a 2C error in the MAX31855, and typically a 3C error in the thermocouple.
+		const int maxTemp(Settings::get(Settings::MAX_TEMP));
+		const int fifths[3] = {3, 4, 5}; // J-STD-20 gives 150C, 200C and the peak
+
+		endTemp = maxTemp * fifths[phase - 1] / 5;
+	}
+	else
+		endTemp = get16(&p.endTemp[phase - 1]);
+
+	minDuration = get16(&p.minDuration[phase - 1]);
+	maxDuration = get16(&p.maxDuration[phase - 1]);
+}
+
+int ReflowProfile::waitingSeconds(int profile)
+{
+	return get16(&profiles[profile].waiting);
+}
+
+int ReflowProfile::liquidus(int profile)
+{
+	return get16(&profiles[profile].liquidus);
+}
@@ -13,6 +13,7 @@
 #define TYPE_COOLING_FAN    5
 #define NO_OF_TYPES         6
 #define isHeatingElement(x) (x == TYPE_TOP_ELEMENT || x == TYPE_BOTTOM_ELEMENT || x == TYPE_BOOST_ELEMENT)
+#define BOOST_MAX_DUTY     60 // The boost element (just a mold heater) should never need more than this
 
 #define TEMP_OFFSET    150 // To allow temp to be saved in 8-bits (0-255)
 #define BAKE_TEMP_STEP   5 // Allows the storing of the temp range in one byte
@@ -20,6 +21,14 @@
 #define BAKE_MIN_TEMP   40 // Minimum temp for baking
 #define BAKE_MAX_TEMP  200 // Maximum temp for baking
 
+#define LOOP_INTERVAL   50 // The control task runs every 50ms (20 times per second)
+
+// Measured temps are integers, in quarters of a degree Celsius (the MAX31855's resolution).
+// This avoids the floating point library.  Use TEMP_C() to compare with whole degrees.
+#define TEMP_SCALE       4
+#define TEMP_C(degrees)  ((degrees) * TEMP_SCALE)
+#define TEMP_FAULT  0x7FFF // The temp returned when the thermocouple has a fault
+
 extern ControLeo2::LiquidCrystal lcd;
 
 class Settings
@@ -56,11 +65,36 @@ public:
 		, REFLOW_D7_DUTY_CYCLE // Duty cycle (0-100) that D4 must be used during reflow
 		, SERVO_OPEN_DEGREES // The position the servo should be in when the door is open
 		, SERVO_CLOSED_DEGREES // The position the servo should be in when the door is closed
+		, TEMP_WINDOW // Thermocouple readings to average over (1-16, 0 = 5 readings = 1 second)
+		, BAKE_KP // Bake PID proportional gain, in 0.1% duty cycle per degree (0 = default)
+		, BAKE_KI // Bake PID integral gain, in 0.0001% per degree second (0 = default)
+		, BAKE_KD // Bake PID derivative gain, in 1% per degree per second (0 = default)
+		, REFLOW_TRACKING // Reflow follows a target curve instead of the learned duty cycles (see Reflow.cpp)
+		, AUTOTUNE_GAIN // Oven model gain, in 0.1C per % of full power (0 = not measured, see Autotune.cpp)
+		, AUTOTUNE_TIME_CONSTANT // Oven model time constant (divided by 10 seconds)
+		, AUTOTUNE_DEAD_TIME // Oven model dead time (seconds)
+		, REFLOW_PROFILE // The selected reflow profile (see ReflowProfiles.cpp)
+
+		// Learning mode and duty cycles (laid out like LEARNING_MODE to REFLOW_D7_DUTY_CYCLE)
+		// for each reflow profile after the first
+		, PROFILE_LEARNING_MODE = 64
+
+		// User drying presets (see DryingPresets::SLOT_SETTINGS for the layout)
+		, USER_PRESETS = 128
+
+		, SETTINGS_SIZE = 160 // Settings below this are kept in RAM (see Settings.cpp)
+		// Then the settings header: magic number, version and two copies of the CRC (7 bytes)
+
+		// Then the run history, from 176 (see History.cpp), and the temp trace, from 544 (see Trace.cpp)
+		// The end of the EEPROM (from 768) is the journal (see Journal.cpp)
 	};
 
 	static void ensureInitialized(void);
+	static void restoreDefaults(void); // Factory reset
 	static int get(int settingNum);
 	static void set(int settingNum, int value);
+	static void writeBehind(void); // Write one changed setting, if the EEPROM isn't busy
+	static void flush(void);       // Write all the changed settings (waits for the EEPROM)
 };
 
 class Tunes
@@ -80,27 +114,274 @@ public:
 	static void playReflowComplete(void) { play(REFLOW_COMPLETE); }
 	static void playRemoveBoards(void) { play(REMOVE_BOARDS); }
 
+	static void tick(void); // Called from the Timer 1 interrupt every 20ms
+
 private:
 	static void play(int tune);
 };
 
+// Main loop timing statistics (see LoopStats.cpp)
+class LoopStats
+{
+public:
+	enum {
+		NO_OF_BUCKETS = 12 // Histogram buckets: <128us, <256us, ... <64ms, >=64ms
+	};
+
+	static void record(uint32_t workMicros, bool behind);
+	static void reset(void);
+	static void dump(void);
+};
+
+// Main loop task scheduler (see Scheduler.cpp)
+class Scheduler
+{
+public:
+	enum {
+		CONTROL
+		, BUTTONS
+		, DISPLAY
+		, LOGGING
+		, EEPROM_WRITES
+		, NO_OF_TASKS
+	};
+
+	static void begin(void);
+	static void run(void);
+	static bool isNewSecond(void); // For one control task each second (the LCD, history, bake PID)
+	static void markSecond(void);  // Called by the display task
+	static void reset(void);
+	static void dump(void);
+};
+
+// Thermocouple filter statistics (see Thermocouple.cpp)
+class ThermocoupleStats
+{
+public:
+	static int recentFaults(void); // Faulty readings in the current window
+	static void counts(uint16_t &faults, uint16_t &spikes); // Since the last reset
+	static void reset(void);
+	static void dump(void);
+};
+
+// RAM use, from stack painting (see MemoryStats.cpp).  All in bytes.
+class MemoryStats
+{
+public:
+	static int staticRam(void); // The globals (.data and .bss)
+	static int stackMax(void);  // The most stack used since power on
+	static int neverUsed(void); // RAM the stack has never reached
+	static int freeNow(void);   // Between the heap and the stack pointer
+	static void dump(void);
+};
+
+// Wear leveled blocks of settings, in a ring at the end of the EEPROM (see Journal.cpp)
+class Journal
+{
+public:
+	enum {
+		MAX_BLOCKS = 8    // Block numbers are 0 to 7.  Reflow profile n's learning is block n.
+		, RESUME = 7      // The bake checkpoint (see Bake.cpp)
+		, DATA_SIZE = 13
+	};
+
+	static void begin(void); // Find the latest copy of each block
+	static bool read(int block, uint8_t *data); // False if the block has never been written
+	static void write(int block, const uint8_t *data); // Waits for the EEPROM
+	static void post(int block, const uint8_t *data);  // Written by writeBehind
+	static bool writeBehind(void); // Writes one byte.  False if there is nothing to write.
+	static void clear(void);
+};
+
+// A summary of each run, and statistics across runs, kept in EEPROM (see History.cpp)
+class History
+{
+public:
+	enum { REFLOW, BAKE, DRY }; // What was run
+
+	// How the run ended
+	enum {
+		COMPLETED
+		, BUTTON        // Aborted with a button
+		, THERMOCOUPLE  // Aborted because of a thermocouple fault
+		, TOO_FAST      // Aborted by learning mode
+		, TOO_SLOW
+		, RESULTS
+	};
+
+	enum { PHASES = 4 }; // Reflow: presoak, soak, reflow and waiting.  Bake: heatup, bake and cooling.
+
+	// variant is the reflow profile or drying preset.  The time above liquidus (C) is counted
+	// if it isn't 0.
+	static void start(int kind, int variant, int liquidus = 0);
+	static void sample(int temp); // Once a second (quarter degrees)
+	static void phaseDone(int phase, unsigned long seconds);
+	static void adjusted(int phase, int adjustment); // The duty cycles changed.  phase 0 is the presoak.
+	static void end(int result); // Only the first call after start counts
+	static void flush(void);     // Write the run, if it has ended (waits for the EEPROM)
+	static void clear(void);
+	static void dump(void);      // Starts showing the runs and statistics
+	static void dumpNext(void);  // Shows the next line (called from the main loop)
+};
+
+// The temp and outputs of the last run, once a second (see Trace.cpp).  Recorded by History.
+class Trace
+{
+public:
+	static void start(void);
+	static void sample(int temp); // Once a second (quarter degrees)
+	static void stop(void);
+	static void save(uint16_t run); // Write it to the EEPROM (waits for it)
+	static void clear(void);
+	static void dump(void);       // Starts showing it as CSV
+	static void dumpNext(void);   // Shows the next lines (called from the main loop)
+};
+
+// Reflow profiles (see ReflowProfiles.cpp)
+class ReflowProfile
+{
+public:
+	enum { LEARNING_SETTINGS = 1 + 3 * 4 }; // Learning mode, then 4 duty cycles for each phase
+
+	static int count(void);
+	static int selected(void);
+	static const __FlashStringHelper *name(int profile);
+	static int learningSetting(int profile);
+	static int dutyCycleSetting(int profile, int phase, int output); // phase 1 = presoak
+	static void getPhase(int profile, int phase, int &endTemp, int &minDuration, int &maxDuration);
+	static int waitingSeconds(int profile);
+	static int liquidus(int profile); // C
+};
+
+// Drying presets: the built in ones, then the user's (see DryingPresets.cpp)
+struct DryingPreset
+{
+	char name[16];
+	int temp;           // C
+	uint32_t seconds;
+	bool doorOpen;
+	int rampLimit;      // C per minute (0 = no limit)
+};
+
+class DryingPresets
+{
+public:
+	enum { USER_SLOTS = 4 };
+
+	// A user slot's settings, from Settings::USER_PRESETS
+	enum {
+		SLOT_MATERIAL     // 0 = empty, otherwise the material (1 is the first)
+		, SLOT_TEMP       // C
+		, SLOT_DURATION   // See getBakeSeconds
+		, SLOT_DOOR_OPEN
+		, SLOT_RAMP_LIMIT // C per minute (0 = no limit)
+		, SLOT_SETTINGS
+	};
+
+	static int count(void); // The built in presets, then the user slots in use
+	static void get(int preset, DryingPreset &p);
+	static int slotSetting(int slot, int field);
+	static int materialCount(void);
+	static const __FlashStringHelper *materialName(int material);
+	static void setMaterial(int slot, int material); // Also sets the suggested settings
+};
+
+// The oven's thermal model, measured by Autotune (see Autotune.cpp)
+class OvenModel
+{
+public:
+	static bool isValid(void);
+	static void save(int gain, int timeConstant, int deadTime); // 0.1C per %, seconds, seconds
+	// % of full power (0 if not measured).  previousPower (if >= 0) is what was used before.
+	static int rampPower(int fromTemp, int toTemp, int seconds, int previousPower = -1);
+	static int holdPower(int temp) { return rampPower(temp, temp, 1); }
+	static void bakeGains(int &kp, int &ki, int &kd); // Unchanged if not measured
+};
+
+// Binary telemetry (see Telemetry.cpp and TelemetryFormat.h)
+class Telemetry
+{
+public:
+	enum {
+		TEXT               // Human readable text (the default)
+		, BINARY           // Binary frames, every sample
+		, BINARY_DEADBAND  // Binary frames, only samples that have changed
+	};
+
+	static void setMode(int mode);
+	static bool isBinary(void);
+
+	// These send frames, so only call them if isBinary()
+	static void sample(uint8_t source, uint8_t phase, int temp, const int duty[4]
+		, uint16_t seconds, int term0 = 0, int term1 = 0, int term2 = 0);
+	static void phase(uint8_t phase, int endTemp, int minDuration, int maxDuration, const int duty[4]);
+	static void dutyChanged(uint8_t phase, uint8_t output, int from, int to);
+};
+
+// Buffered serial output, so logging never holds up the main loop (see SerialLog.cpp)
+// Use serialLog.print() instead of Serial.print()
+class SerialLog : public Print
+{
+public:
+	enum { BUFFER_SIZE = 384 }; // Holds the biggest burst (the start of a reflow)
+
+	SerialLog();
+
+	virtual size_t write(uint8_t c);
+	virtual size_t write(const uint8_t *buffer, size_t size);
+	using Print::write;
+
+	void drain(void); // Send what the serial port will take without waiting
+	void dump(void);  // Show the dropped output counts
+	void reset(void);
+	size_t space(void) const; // Bytes that can be written without being dropped
+
+private:
+	size_t used(void) const;
+
+	uint8_t _buffer[BUFFER_SIZE];
+	uint16_t _head;          // Where the next byte is written
+	uint16_t _tail;          // The next byte to send
+	size_t _maxUsed;
+	uint32_t _droppedBytes;
+	uint32_t _droppedWrites;
+};
+
+extern SerialLog serialLog;
+
+void processSerialCommands(void);
+
 void initializeTimer(void);
 bool Config(void);
 bool Reflow(void);
 bool Testing(void);
+bool Autotune(void);
 bool Bake(void);
-bool RefreshPla(void);
-bool DryPla(void);
-bool DryAbs(void);
-bool DryPetg(void);
-bool DryNylon(void);
-bool DryDesiccant(void);
+bool Dry(int preset);
+bool resumeBake(int &preset);
+const __FlashStringHelper *outputName(int type); // TYPE_UNUSED etc.
 
 int getButton(void);
+
+// The main loop tasks (see Scheduler.cpp)
+void controlTask(void);
+void buttonTask(void);
+void displayTask(void);
 uint32_t getBakeSeconds(int duration);
-int getCurrentTemp(double &target); // 0 = success, 1 = open fault, 2 = short to gnd, 3 = short to vcc
+// The latest thermocouple result, published by the Timer 1 interrupt
+struct TempSnapshot
+{
+	int temp;         // Average temp in quarter degrees (TEMP_FAULT if there is a fault)
+	uint8_t fault;    // 0 = success, 1 = open fault, 2 = short to gnd, 3 = short to vcc
+	uint8_t sequence; // Goes up by one with every reading (200ms)
+	uint32_t time;    // millis() when the reading was taken
+};
+
+void getTempSnapshot(TempSnapshot &snapshot);
+int getCurrentTemp(int &target); // Quarter degrees.  0 = success, 1 = open fault, 2 = short to gnd, 3 = short to vcc
+void printTemp(Print &out, int temp); // Prints quarter degrees as degrees, with 2 decimal places
 void displayTemp(void);
-void displayTemp(double);
+void displayTemp(int);
 
 void setServoPosition(unsigned int servoDegrees, int timeToTake);
 
@@ -112,4 +393,5 @@ void lcdPrintLine(int line, const char *str);
 void lcdPrintLineF(int line, const __FlashStringHelper *, int leadingSpaces = 0);
 
 void takeCurrentThermocoupleReading(void);
+void setThermocoupleWindow(int readings);
 
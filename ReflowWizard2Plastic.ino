@@ -112,8 +112,12 @@
 
 // ***** TYPE DEFINITIONS *****
 
+#define NO_OF_MODES 5
+#define NEXT_MODE false
+
 ControLeo2::LiquidCrystal lcd;
 int mode(0);
+bool showMainMenu(true);
 
 void setup()
 {
@@ -136,6 +140,8 @@ void setup()
 	// Create the degree symbol for the LCD - you can display this with lcd.print("\1") or lcd.write(1)
 	unsigned char degree[8]  = {12,18,18,12,0,0,0,0};
 	lcd.createChar(1, degree);
+	// From now on the LCD is written from the Timer 0 interrupt, so lcd.print() doesn't wait
+	lcd.setAsync(true);
 	// *********** End of ControLeo2 initialization ***********
 
 	// Log data to the computer using USB
@@ -153,70 +159,92 @@ void setup()
 
 	// Initialize the EEPROM, after flashing bootloader
 	Settings::ensureInitialized();
+	setThermocoupleWindow(Settings::get(Settings::TEMP_WINDOW));
 	lcd.clear();
 
 	// Go straight to reflow menu if learning is complete
-	if ( Settings::get(Settings::LEARNING_MODE) == false )
+	if ( Settings::get(ReflowProfile::learningSetting(ReflowProfile::selected())) == false )
 		mode = 2;
 
-	Serial.println(F("ControLeo2 Reflow Oven controller v1.9"));
+	serialLog.println(F("ControLeo2 Reflow Oven controller v1.9"));
 
 	// Make sure the oven door is closed
 	setServoPosition(Settings::get(Settings::SERVO_CLOSED_DEGREES), 1000);
-}
 
-#define NO_OF_MODES 10
-#define NEXT_MODE false
+	// Carry on with a bake that the power went off in the middle of (the door is opened again
+	// if the bake needs it)
+	int preset;
 
-// Main menu options
+	if ( resumeBake(preset) )
+	{
+		mode = preset < 0 ? 3 : NO_OF_MODES + preset;
+		showMainMenu = false;
+	}
+
+	Scheduler::begin();
+}
+
+// Main menu options.  The drying presets follow these (see DryingPresets.cpp).
 bool (*action[NO_OF_MODES])() = {Testing
 								, Config
 								, Reflow
 								, Bake
-								, RefreshPla
-								, DryPla
-								, DryAbs
-								, DryPetg
-								, DryNylon
-								, DryDesiccant};
-const char *modes[NO_OF_MODES] = {"Test Outputs?"
-								, "Setup?"
-								, "Start Reflow?"
-								, "Start Baking?"
-								, "Refresh PLA?"
-								, "Dry PLA?"
-								, "Dry Abs?"
-								, "Dry Petg?"
-								, "Dry Nylon?"
-								, "Dry Desiccant?"};
-
-// This loop is executed 20 times per second
+								, Autotune};
+
+const char TEST_OUTPUTS_FSTR[] PROGMEM = "Test Outputs?";
+const char SETUP_FSTR[] PROGMEM = "Setup?";
+const char START_REFLOW_FSTR[] PROGMEM = "Start Reflow?";
+const char START_BAKING_FSTR[] PROGMEM = "Start Baking?";
+const char AUTOTUNE_FSTR[] PROGMEM = "Autotune?";
+
+const char *const modes[NO_OF_MODES] PROGMEM = {TEST_OUTPUTS_FSTR
+								, SETUP_FSTR
+								, START_REFLOW_FSTR
+								, START_BAKING_FSTR
+								, AUTOTUNE_FSTR};
+
+void drawMode(void)
+{
+	if ( mode < NO_OF_MODES )
+	{
+		lcdPrintLineF(0, (const __FlashStringHelper *) pgm_read_ptr(&modes[mode]));
+		return;
+	}
+
+	DryingPreset preset;
+	char buf[17];
+
+	DryingPresets::get(mode - NO_OF_MODES, preset);
+	snprintf_P(buf, sizeof(buf), PSTR("%s?"), preset.name);
+	lcdPrintLine(0, buf);
+}
+
+// The tasks, and how often each runs, are in Scheduler.cpp
 void loop()
+{
+	Scheduler::run();
+}
+
+// Runs the main menu, or the mode that was picked from it.  Every 50ms.
+void controlTask(void)
 {
 	static bool drawMenu(true);
-	static bool showMainMenu(true);
-	static int counter(0);
-	static unsigned long nextLoopTime = 50; // Should be 3000 + 100 + fudge factor + 50 - but no harm making it 50!
 
 	if ( showMainMenu )
 	{
 		if ( drawMenu )
 		{
 			drawMenu = false;
-			lcdPrintLine(0, modes[mode]);
+			drawMode();
 			lcdPrintLineF(1, F("Yes ->"), 10);
 		}
 
-		// Update the temp roughtly once per second
-		if ( ! (counter++ % 20) )
-			displayTemp();
-
 		// Get the button press to select the mode or move to the next mode
 		switch ( getButton() )
 		{
 		case CONTROLEO_BUTTON_TOP:
 			// Move to the next mode
-			mode = (mode + 1) % NO_OF_MODES;
+			mode = (mode + 1) % (NO_OF_MODES + DryingPresets::count());
 			drawMenu = true;
 			break;
 
@@ -230,15 +258,31 @@ void loop()
 	else
 	{
 		// Go to the mode's menu system
-		if ( (*action[mode])() == NEXT_MODE )
+		const bool keepGoing(mode < NO_OF_MODES ? (*action[mode])() : Dry(mode - NO_OF_MODES));
+
+		if ( keepGoing == NEXT_MODE )
+		{
 			showMainMenu = true;
+
+			// The run is over, so save what it changed now rather than a byte at a time
+			Settings::flush();
+			History::flush();
+
+			// The Setup menu can remove user presets
+			if ( mode >= NO_OF_MODES + DryingPresets::count() )
+				mode = 0;
+		}
 	}
+}
 
-	// Execute this loop 20 times per second (every 50ms).
-	if ( millis() < nextLoopTime )
-		delay(nextLoopTime - millis());
+// Once a second.  The main menu shows the temp; a mode shows its own screen (see
+// Scheduler::isNewSecond).
+void displayTask(void)
+{
+	if ( showMainMenu )
+		displayTemp();
 
-	nextLoopTime += 50;
+	Scheduler::markSecond();
 }
 
 // Determine if a button was pressed (with debounce)
@@ -251,13 +295,15 @@ void loop()
 // Note: If both buttons are pressed simultaneously, CONTROLEO_BUTTON_TOP will be returned
 #define DEBOUNCE_INTERVAL  200
 
-int getButton(void)
+int pressedButton(CONTROLEO_BUTTON_NONE); // Waiting for getButton
+
+int readButton(void)
 {
-	static long lastChangeMillis(0);
-	long nowMillis(millis());
+	static unsigned long lastChangeMillis(0);
+	unsigned long nowMillis(millis());
 
 	// If insufficient time has passed, just return none pressed
-	if ( lastChangeMillis + DEBOUNCE_INTERVAL > nowMillis )
+	if ( nowMillis - lastChangeMillis < DEBOUNCE_INTERVAL )
 		return CONTROLEO_BUTTON_NONE;
 
 	// Read the current button status
@@ -281,6 +327,22 @@ int getButton(void)
 	return buttonValue;
 }
 
+// The buttons task, every 20ms.  A press is kept until the control task asks for it, so it
+// isn't missed while a mode is busy.
+void buttonTask(void)
+{
+	if ( pressedButton == CONTROLEO_BUTTON_NONE )
+		pressedButton = readButton();
+}
+
+int getButton(void)
+{
+	const int button(pressedButton);
+
+	pressedButton = CONTROLEO_BUTTON_NONE;
+	return button;
+}
+
 // Display a line on the LCD screen
 // The provided string is padded to take up the whole line
 // There is less flicker when overwriting characters on the screen, compared
@@ -317,12 +379,12 @@ void displayTemp(void)
 {
 	lcd.setCursor(0, 1);
 
-	double temp(0.0);
+	int temp(0);
 	int fault(getCurrentTemp(temp));
 
 	if ( ! fault )
 	{
-		lcd.print(temp);
+		printTemp(lcd, temp);
 		lcd.print("\1C ");
 	}
 	else
@@ -331,10 +393,10 @@ void displayTemp(void)
 	}
 }
 
-void displayTemp(double temp)
+void displayTemp(int temp)
 {
 	lcd.setCursor(0, 1);
-	lcd.print(temp);
+	printTemp(lcd, temp);
 	lcd.print("\1C ");
 }
 
@@ -0,0 +1,180 @@
+// Main loop task scheduler
+// The work of the main loop is split into tasks, each run at its own rate (see the table).
+// loop() runs the first task in the table that is due, one task per call, so the control
+// task is never stuck behind serial output or an EEPROM write that happened to come first.
+// When nothing is due it waits for the next task.
+//
+// Each task has a deadline: how late it can start before it counts as a miss.  A task that
+// falls more than a period behind starts again from now, rather than running back to back to
+// catch up.  Times are compared as differences, so millis() wrapping (after 49 days) doesn't
+// matter.
+//
+// The running mode still draws its own LCD screen (it has the numbers to show), but only once
+// a second, when the display task says to (isNewSecond).  Its other once a second work (the
+// run history, the bake's PID) goes with it, so the modes don't count control tasks to find
+// the second.  The tunes aren't in the table: they are played from the Timer 1 interrupt (see
+// Tunes.cpp), so nothing here can delay them.
+//
+// The "s" serial command shows how many times each task ran, its deadline misses and the
+// latest it started.
+
+#include <Arduino.h>
+#include "ReflowWizard.h"
+
+namespace {
+
+struct Task
+{
+	void (*run)(void);
+	uint16_t period;   // ms
+	uint16_t deadline; // How late (ms) it can start without it being a miss
+};
+
+struct TaskStats
+{
+	uint32_t nextRun;  // millis()
+	uint32_t runs;
+	uint32_t misses;
+	uint16_t maxLate;  // ms
+};
+
+void loggingTask(void)
+{
+	processSerialCommands();
+	serialLog.drain();
+}
+
+void eepromTask(void)
+{
+	Settings::writeBehind();
+}
+
+// In order of priority.  Indexed by Scheduler::CONTROL etc.
+const Task tasks[Scheduler::NO_OF_TASKS] PROGMEM = {
+	{controlTask, LOOP_INTERVAL, 10}
+	, {buttonTask, 20, 20}
+	, {displayTask, 1000, 200}
+	, {loggingTask, 10, 50}
+	, {eepromTask, 10, 100}
+};
+
+const char CONTROL_FSTR[] PROGMEM = "control";
+const char BUTTONS_FSTR[] PROGMEM = "buttons";
+const char DISPLAY_FSTR[] PROGMEM = "display";
+const char LOGGING_FSTR[] PROGMEM = "logging";
+const char EEPROM_FSTR[] PROGMEM = "EEPROM";
+
+const char *const taskNames[Scheduler::NO_OF_TASKS] PROGMEM = {CONTROL_FSTR
+								, BUTTONS_FSTR
+								, DISPLAY_FSTR
+								, LOGGING_FSTR
+								, EEPROM_FSTR};
+
+TaskStats stats[Scheduler::NO_OF_TASKS];
+bool secondDue;   // Set by the display task
+bool isSecond;    // For the control task that is running
+
+void runTask(int task, uint32_t late)
+{
+	TaskStats &s(stats[task]);
+	const uint16_t period(pgm_read_word(&tasks[task].period));
+	const uint32_t startMicros(micros());
+
+	++s.runs;
+
+	if ( late > pgm_read_word(&tasks[task].deadline) )
+		++s.misses;
+
+	if ( late > s.maxLate )
+		s.maxLate = late > 0xFFFF ? 0xFFFF : late;
+
+	if ( task == Scheduler::CONTROL )
+	{
+		isSecond = secondDue;
+		secondDue = false;
+	}
+
+	((void (*)(void)) pgm_read_ptr(&tasks[task].run))();
+
+	isSecond = false;
+	s.nextRun += period;
+
+	const uint32_t behind(millis() - s.nextRun);
+
+	if ( task == Scheduler::CONTROL )
+		LoopStats::record(micros() - startMicros, (int32_t) behind >= 0);
+
+	if ( (int32_t) behind >= (int32_t) period )
+		s.nextRun = millis();
+}
+
+} // namespace
+
+// Called at the end of setup(), so every task starts now
+void Scheduler::begin(void)
+{
+	const uint32_t now(millis());
+
+	for ( int i = 0; i < NO_OF_TASKS; ++i )
+		stats[i].nextRun = now;
+}
+
+// Called from loop().  Runs the first task that is due, or waits for the next one.
+void Scheduler::run(void)
+{
+	const uint32_t now(millis());
+	uint32_t wait(0xFFFFFFFF);
+
+	for ( int i = 0; i < NO_OF_TASKS; ++i )
+	{
+		const uint32_t late(now - stats[i].nextRun);
+
+		if ( (int32_t) late >= 0 )
+		{
+			runTask(i, late);
+			return;
+		}
+
+		if ( -late < wait )
+			wait = -late;
+	}
+
+	delay(wait);
+}
+
+// True (for all of one control task) once a second
+bool Scheduler::isNewSecond(void)
+{
+	return isSecond;
+}
+
+void Scheduler::markSecond(void)
+{
+	secondDue = true;
+}
+
+void Scheduler::reset(void)
+{
+	for ( int i = 0; i < NO_OF_TASKS; ++i )
+	{
+		stats[i].runs = 0;
+		stats[i].misses = 0;
+		stats[i].maxLate = 0;
+	}
+}
+
+void Scheduler::dump(void)
+{
+	for ( int i = 0; i < NO_OF_TASKS; ++i )
+	{
+		serialLog.print(F("Task "));
+		serialLog.print((const __FlashStringHelper *) pgm_read_ptr(&taskNames[i]));
+		serialLog.print(F(": runs="));
+		serialLog.print(stats[i].runs);
+		serialLog.print(F(" misses="));
+		serialLog.print(stats[i].misses);
+		serialLog.print(F(" late="));
+		serialLog.print(stats[i].maxLate);
+		serialLog.println(F("ms"));
+	}
+}
@@ -0,0 +1,104 @@
+// Serial commands
+// Single character commands can be sent to ControLeo2 over the USB serial port.
+// They are checked by the logging task (every 10ms, see Scheduler.cpp) and never wait for input.
+//   l  Show the main loop timing statistics
+//   L  Show the main loop timing statistics and then reset them
+//   s  Show the task statistics: runs, deadline misses and the latest start of each task
+//   S  Show the task statistics and then reset them
+//   t  Show the thermocouple filter statistics
+//   T  Show the thermocouple filter statistics and then reset them
+//   m  Show the RAM use: globals, the most stack used and what the stack has never reached
+//   h  Show the run history, and the statistics for each reflow profile
+//   c  Show the temp trace of the last run, as CSV
+//   d  Show how many bytes have been sent to the LCD, and how many were skipped
+//   o  Show how much serial output was dropped because the log buffer was full
+//   O  Show how much serial output was dropped and then reset the counts
+//   a  Send reflow and bake data as text (the default)
+//   b  Send reflow and bake data as binary frames (see Telemetry.cpp)
+//   B  Send reflow and bake data as binary frames, skipping samples that haven't changed
+
+#include <Arduino.h>
+#include "ReflowWizard.h"
+
+void processSerialCommands(void)
+{
+	while ( Serial.available() > 0 )
+	{
+		switch ( Serial.read() )
+		{
+		case 'l':
+			LoopStats::dump();
+			break;
+
+		case 'L':
+			LoopStats::dump();
+			LoopStats::reset();
+			break;
+
+		case 's':
+			Scheduler::dump();
+			break;
+
+		case 'S':
+			Scheduler::dump();
+			Scheduler::reset();
+			break;
+
+		case 't':
+			ThermocoupleStats::dump();
+			break;
+
+		case 'T':
+			ThermocoupleStats::dump();
+			ThermocoupleStats::reset();
+			break;
+
+		case 'm':
+			MemoryStats::dump();
+			break;
+
+		case 'h':
+			History::dump();
+			break;
+
+		case 'c':
+			Trace::dump();
+			break;
+
+		case 'd':
+			serialLog.print(F("LCD: sent="));
+			serialLog.print(lcd.bytesSent());
+			serialLog.print(F(" skipped="));
+			serialLog.println(lcd.bytesSkipped());
+			break;
+
+		case 'o':
+			serialLog.dump();
+			break;
+
+		case 'O':
+			serialLog.dump();
+			serialLog.reset();
+			break;
+
+		case 'a':
+			Telemetry::setMode(Telemetry::TEXT);
+			break;
+
+		case 'b':
+			Telemetry::setMode(Telemetry::BINARY);
+			break;
+
+		case 'B':
+			Telemetry::setMode(Telemetry::BINARY_DEADBAND);
+			break;
+
+		default:
+			break; // Ignore anything else (including line endings)
+		}
+	}
+
+	// The history and trace are long, so they are sent a bit at a time
+	History::dumpNext();
+	Trace::dumpNext();
+}
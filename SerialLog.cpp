@@ -0,0 +1,122 @@
+// Buffered serial output
+// On the Leonardo the serial port is USB.  Serial.print() waits if the USB buffer is full
+// (e.g. the PC isn't reading), and every print can become a USB packet of its own.
+// Either way the control loop is held up.
+//
+// Everything the sketch logs goes to serialLog instead.  It only copies the text into
+// a ring buffer, and never waits.  The main loop calls drain() once it has finished its
+// work for the tick.  That writes as much as the USB buffer will take right now, in
+// chunks of up to one USB packet.  If the ring is full the new output is dropped and
+// counted (see the 'o' serial command).
+//
+// Writes of more than one byte (print(const char *), telemetry frames) are all or nothing,
+// so a telemetry frame is never cut short.
+
+#include <Arduino.h>
+#include "ReflowWizard.h"
+
+#define PACKET_SIZE 64 // USB full speed bulk packet
+
+SerialLog serialLog;
+
+SerialLog::SerialLog()
+	: _head(0)
+	, _tail(0)
+	, _maxUsed(0)
+	, _droppedBytes(0)
+	, _droppedWrites(0)
+{
+}
+
+size_t SerialLog::write(uint8_t c)
+{
+	return write(&c, 1);
+}
+
+size_t SerialLog::write(const uint8_t *buffer, size_t size)
+{
+	if ( size > space() )
+	{
+		// Make room by sending what USB will take now.  This doesn't wait.
+		drain();
+
+		if ( size > space() )
+		{
+			_droppedBytes += size;
+			++_droppedWrites;
+			return 0;
+		}
+	}
+
+	for ( size_t i = 0; i < size; ++i )
+	{
+		_buffer[_head] = buffer[i];
+		_head = (_head + 1) % BUFFER_SIZE;
+	}
+
+	if ( used() > _maxUsed )
+		_maxUsed = used();
+
+	return size;
+}
+
+void SerialLog::drain(void)
+{
+	while ( _tail != _head )
+	{
+		int room(Serial.availableForWrite());
+
+		if ( room <= 0 )
+			return; // Try again next tick
+
+		// Send the bytes up to the end of the buffer (or the head) in one go
+		int count((_head > _tail ? _head : BUFFER_SIZE) - _tail);
+
+		if ( count > room )
+			count = room;
+
+		if ( count > PACKET_SIZE )
+			count = PACKET_SIZE;
+
+		count = Serial.write(&_buffer[_tail], count);
+
+		if ( count <= 0 )
+			return; // Nothing is listening on the port
+
+		_tail = (_tail + count) % BUFFER_SIZE;
+	}
+}
+
+size_t SerialLog::used(void) const
+{
+	return (_head + BUFFER_SIZE - _tail) % BUFFER_SIZE;
+}
+
+size_t SerialLog::space(void) const
+{
+	return BUFFER_SIZE - 1 - used();
+}
+
+void SerialLog::dump(void)
+{
+	// Copy these first, because printing changes them
+	const uint32_t droppedBytes(_droppedBytes);
+	const uint32_t droppedWrites(_droppedWrites);
+	const size_t maxUsed(_maxUsed);
+
+	print(F("Log: dropped="));
+	print(droppedBytes);
+	print(F(" bytes in "));
+	print(droppedWrites);
+	print(F(" writes, max used="));
+	print((unsigned) maxUsed);
+	print('/');
+	println(BUFFER_SIZE - 1);
+}
+
+void SerialLog::reset(void)
+{
+	_droppedBytes = 0;
+	_droppedWrites = 0;
+	_maxUsed = used();
+}
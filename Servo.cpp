@@ -1,6 +1,7 @@
-// Timer 1 is used for 2 things:
+// Timer 1 is used for 3 things:
 // 1. Take thermocouple readings every 200ms (5 times per second)
 // 2. Control the servo used to open the oven door
+// 3. Start the notes of the tune that is playing (see Tunes.cpp)
 //
 // Servo timer interrupt operation
 // ===============================
@@ -10,6 +11,8 @@
 //   - Timer 1 is set to CTC mode
 //   - Compare A is set to a value to force a timer interrupt every 20ms
 // For every 10 times the timer fires, a call is made to get a thermocouple reading.
+// On ControLeo2 the reading only takes microseconds (see MAX31855_FAST_READ), so the servo
+// pulse is still sent on that tick.  With the slow digitalWrite reading it is skipped.
 // If servo movement is enabled (interrupt on Compare B, OCIE1B is set) then the servo pin
 // is set high.  It must be lowered somewhere between 1ms and 2ms later, depending on the desired
 // position.  To do this, the appropriate value is written to OCR1B.  Keep in mind that unlike
@@ -24,6 +27,7 @@
 // the compare register OCR1A to 2,000,000 / 50 = 40,000.
 
 #include <Arduino.h>
+#include <ControLeo2.h>
 #include "ReflowWizard.h"
 
 #define SERVO_PIN          3 // The I/O pin used for the servo
@@ -74,14 +78,16 @@ ISR(TIMER1_COMPA_vect)
 	volatile static int thermocoupleTimer(0);
 
 	// Read the thermocouple 5 times per second (every 0.2 seconds)
-	if ( ++thermocoupleTimer >= 10 )
-	{
+	const bool readThermocouple(++thermocoupleTimer >= 10);
+
+	if ( readThermocouple )
 		thermocoupleTimer = 0;
-		takeCurrentThermocoupleReading();
 
-		// Don't move the servo - the pulse won't have the correct timing because of the time taken to read the thermocouple
-	}
-	else
+#if ! MAX31855_FAST_READ
+	// Don't move the servo - the pulse won't have the correct timing because of the time taken to read the thermocouple
+	// (A fast read only takes microseconds, so the servo can be moved on every tick)
+	if ( ! readThermocouple )
+#endif
 	{
 		// Is the servo timer interrupt active?
 		if ( TIMSK1 & _BV(OCIE1B) )
@@ -102,6 +108,13 @@ ISR(TIMER1_COMPA_vect)
 			}
 		}
 	}
+
+	// Read the thermocouple after the servo pulse has started, so it doesn't delay the pulse
+	if ( readThermocouple )
+		takeCurrentThermocoupleReading();
+
+	// Do this last, so it doesn't delay the start of the servo pulse
+	Tunes::tick();
 }
 
 // Timer 1 Compare B interrrupt
@@ -114,9 +127,11 @@ ISR(TIMER1_COMPB_vect)
 // Move the servo to servoDegrees, in timeToTake milliseconds (1/1000 second)
 void setServoPosition(unsigned int servoDegrees, int timeToTake)
 {
-	char buf[80];
-	snprintf(buf, sizeof(buf), "Servo: move to %d degrees, over %d ms", servoDegrees, timeToTake);
-	Serial.println(buf);
+	serialLog.print(F("Servo: move to "));
+	serialLog.print(servoDegrees);
+	serialLog.print(F(" degrees, over "));
+	serialLog.print(timeToTake);
+	serialLog.println(F(" ms"));
 
 	if ( servoDegrees <= 180 ) // only allow 0 - 180 degrees
 	{
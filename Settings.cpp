@@ -3,49 +3,397 @@
 // EEPROM is set to 0xFF (255).  One of the first things done when powering up is to
 // see if the EEPROM is uninitialized - and initialize it if that is the case.
 //
+// After the settings is a header: a magic number, the version of the settings layout and two
+// copies of a CRC of the settings.  At power on, the CRC is worked out as the settings are read
+// into RAM.
+// - No magic number: if EEPROM_NEEDS_INIT is set (erased EEPROM) the defaults are written,
+//   otherwise the settings are from before the header (version 1) and are upgraded.
+// - Neither copy of the CRC matches, or a version newer than this firmware: the defaults are
+//   written.  The journal and the run history have their own CRCs, so they are kept.
+// - An older version: the settings are upgraded one version at a time (see upgrade).
+// Writing the defaults (and a factory reset) only writes the settings bytes that are different.
+//
+// The power can go off part way through writing a setting, so each setting byte is written
+// like this (see writeNext): the CRC the settings will have is written to one copy, then the
+// setting byte.  The other copy still matches the settings until the byte is written, and the
+// next byte uses the other copy.  So at any time, one of the copies matches the settings.
+//
 // All settings are stored as bytes (unsigned 8-bit values).  This presents a problem
 // for the maximum temp which can be as high as 280C - which doesn't fit in a
 // 8-bit variable.  With the goal of making getSetting/setSetting as simple as possible,
 // we could've saved all values as 16-bit values, using consecutive EEPROM locations. We
 // instead chose to just offset the temp by 150C, making the range 25 to 130 instead
 // of 175 to 280.
+//
+// The settings (up to SETTINGS_SIZE) are read into RAM at power on, and read from there.
+// An EEPROM write takes 3.3ms, and a second write has to wait for the first to finish, so
+// changes aren't written straight away.  They are marked as dirty, and the main loop writes
+// one of them each time around (writeBehind), when the last write has finished.  Nothing
+// that runs the oven waits for the EEPROM.  flush() writes the rest when a run ends.
+//
+// The learning mode and duty cycles of each reflow profile change after most reflows, so they
+// are kept in the journal (see Journal.cpp), which spreads the writes over the end of the
+// EEPROM.  They are only written by flush(), a whole profile at a time.  Their settings
+// addresses hold what was learned before the journal was used, until the journal has a copy.
 
 #include <Arduino.h>
 #include <EEPROM.h>
 #include <ControLeo2.h>
 #include "ReflowWizard.h"
 
-void Settings::ensureInitialized(void)
+namespace {
+
+#define SETTINGS_MAGIC   0x5752 // "RW"
+#define SETTINGS_VERSION 4      // 1 is the layout from before the header, 2 had no run history,
+                                // 3 had no temp trace
+
+#define NO_SETTING       -1
+
+// At Settings::SETTINGS_SIZE
+struct Header
+{
+	uint16_t magic;
+	uint8_t version;
+	uint16_t crc[2]; // Written in turn (see writeNext)
+} __attribute__((packed));
+
+// Writing a setting byte: the CRC to one copy (2 steps), then the byte
+enum { CRC_LOW, CRC_HIGH, SETTING_BYTE };
+
+uint8_t cache[Settings::SETTINGS_SIZE];
+uint8_t dirty[(Settings::SETTINGS_SIZE + 7) / 8]; // A bit for each setting that needs writing
+int nextDirty; // Where writeBehind looks first
+bool anyDirty; // A setting has been marked dirty since startNext last found nothing to write
+bool headerChanged; // The magic number and version need writing (upgrade or defaults)
+uint16_t loadedCrc; // Of the settings as they were read from EEPROM
+
+// The setting byte being written
+int pendingSetting(NO_SETTING);
+uint8_t pendingValue;
+uint16_t pendingCrc; // Of the settings once it is written
+uint8_t pendingStep;
+uint8_t nextCopy;    // The copy of the CRC the next byte uses
+
+// CRC-16-CCITT
+uint16_t crc16(uint16_t crc, uint8_t data)
+{
+	crc ^= (uint16_t) data << 8;
+
+	for ( int i = 0; i < 8; ++i )
+		crc = crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1;
+
+	return crc;
+}
+
+// The CRC of the settings in EEPROM (which isn't the same as the RAM copy, because the
+// learning is kept in the journal), with the setting being written changed to value
+uint16_t eepromCrc(int settingNum, uint8_t value)
 {
-	// Does the EEPROM need to be initialized?
-	if ( get(EEPROM_NEEDS_INIT) )
+	uint16_t crc(0xFFFF);
+
+	for ( int i = 0; i < Settings::SETTINGS_SIZE; ++i )
+		crc = crc16(crc, i == settingNum ? value : EEPROM.read(i));
+
+	return crc;
+}
+
+int crcAddress(int copy)
+{
+	return Settings::SETTINGS_SIZE + offsetof(Header, crc) + copy * sizeof(uint16_t);
+}
+
+// Write the whole header (waits for the EEPROM).  The CRCs go first, so the header isn't
+// valid until the magic number is there.
+void writeHeader(void)
+{
+	const uint16_t crc(eepromCrc(NO_SETTING, 0));
+
+	for ( int copy = 0; copy < 2; ++copy )
+		EEPROM.put(crcAddress(copy), crc);
+
+	EEPROM.update(Settings::SETTINGS_SIZE + offsetof(Header, version), SETTINGS_VERSION);
+	EEPROM.put(Settings::SETTINGS_SIZE + offsetof(Header, magic), (uint16_t) SETTINGS_MAGIC);
+}
+
+void load(void)
+{
+	loadedCrc = 0xFFFF;
+
+	for ( int i = 0; i < Settings::SETTINGS_SIZE; ++i )
 	{
-		// Initialize all the settings to 0 (false)
-		for ( int i = 0; i < 1024; ++i )
-			EEPROM.write(i, 0);
-
-		set(MAX_TEMP, 240); // Set a reasonable max temp
-		set(SERVO_CLOSED_DEGREES, 90); // Set the servos to neutral positions (90 degrees)
-		set(SERVO_OPEN_DEGREES, 90);
-		set(BAKE_TEMP, BAKE_MIN_TEMP); // Set default baking temp
+		cache[i] = EEPROM.read(i);
+		loadedCrc = crc16(loadedCrc, cache[i]);
 	}
 
-	// Legacy support - Initialize the rest of EEPROM for upgrade from 1.x to 1.4
-	if ( get(SERVO_OPEN_DEGREES) > 180 )
+	memset(dirty, 0, sizeof(dirty));
+	pendingSetting = NO_SETTING;
+
+	// The journal has the latest learning
+	Journal::begin();
+
+	for ( int profile = 0; profile < ReflowProfile::count(); ++profile )
+		Journal::read(profile, &cache[ReflowProfile::learningSetting(profile)]);
+}
+
+// The journal block (reflow profile) the setting is kept in, or -1 if it isn't
+int journalBlock(int settingNum)
+{
+	for ( int profile = 0; profile < ReflowProfile::count(); ++profile )
+	{
+		const int first(ReflowProfile::learningSetting(profile));
+
+		if ( settingNum >= first && settingNum < first + ReflowProfile::LEARNING_SETTINGS )
+			return profile;
+	}
+
+	return -1;
+}
+
+bool isDirty(int settingNum)
+{
+	return dirty[settingNum / 8] & (1 << (settingNum % 8));
+}
+
+void clearDirty(int settingNum)
+{
+	dirty[settingNum / 8] &= ~(1 << (settingNum % 8));
+}
+
+uint8_t readRaw(int settingNum)
+{
+	return settingNum < Settings::SETTINGS_SIZE ? cache[settingNum] : EEPROM.read(settingNum);
+}
+
+void writeRaw(int settingNum, uint8_t value)
+{
+	// Anything past the cache is written straight away
+	if ( settingNum >= Settings::SETTINGS_SIZE )
 	{
-		for ( int i = SERVO_OPEN_DEGREES; i < 1024; ++i )
-			EEPROM.write(i, 0);
+		EEPROM.update(settingNum, value);
+		return;
+	}
 
-		set(SERVO_CLOSED_DEGREES, 90);
-		set(SERVO_OPEN_DEGREES, 90);
-		set(BAKE_TEMP, BAKE_MIN_TEMP);
+	if ( cache[settingNum] != value )
+	{
+		cache[settingNum] = value;
+		dirty[settingNum / 8] |= 1 << (settingNum % 8);
+		anyDirty = true;
 	}
 }
 
-// Get the setting from EEPROM
+// Start writing the next dirty setting (skipping the journal's) that is different in EEPROM.
+// Returns false if there aren't any.
+bool startNext(void)
+{
+	// Most of the time there is nothing to write, so don't look through them all every time
+	if ( ! anyDirty )
+		return false;
+
+	for ( int n = 0; n < Settings::SETTINGS_SIZE; ++n )
+	{
+		const int i(nextDirty);
+
+		nextDirty = (nextDirty + 1) % Settings::SETTINGS_SIZE;
+
+		if ( isDirty(i) && journalBlock(i) < 0 )
+		{
+			clearDirty(i);
+
+			if ( EEPROM.read(i) == cache[i] )
+				continue;
+
+			pendingSetting = i;
+			pendingValue = cache[i];
+			pendingCrc = eepromCrc(i, pendingValue);
+			pendingStep = CRC_LOW;
+			return true;
+		}
+	}
+
+	anyDirty = false;
+	return false;
+}
+
+// Write the next byte of a dirty setting: the CRC to one copy, then the setting byte (see
+// the top of this file).  Returns false if there is nothing to write.
+bool writeNext(void)
+{
+	if ( pendingSetting == NO_SETTING && ! startNext() )
+		return false;
+
+	switch ( pendingStep++ )
+	{
+	case CRC_LOW:
+		EEPROM.update(crcAddress(nextCopy), pendingCrc & 0xFF);
+		break;
+
+	case CRC_HIGH:
+		EEPROM.update(crcAddress(nextCopy) + 1, pendingCrc >> 8);
+		break;
+
+	default:
+		EEPROM.update(pendingSetting, pendingValue);
+		pendingSetting = NO_SETTING;
+		nextCopy ^= 1;
+		break;
+	}
+
+	return true;
+}
+
+// Write each reflow profile's learning that has changed to the journal
+void writeJournal(void)
+{
+	for ( int profile = 0; profile < ReflowProfile::count(); ++profile )
+	{
+		const int first(ReflowProfile::learningSetting(profile));
+		bool changed(false);
+
+		for ( int i = first; i < first + ReflowProfile::LEARNING_SETTINGS; ++i )
+		{
+			if ( isDirty(i) )
+			{
+				clearDirty(i);
+				changed = true;
+			}
+		}
+
+		if ( changed )
+			Journal::write(profile, &cache[first]);
+	}
+}
+
+// Upgrade the settings from an older layout, one version at a time
+void upgrade(int version)
+{
+	serialLog.print(F("Upgrading settings from version "));
+	serialLog.println(version);
+
+	switch ( version )
+	{
+	case 1:
+		// Before 1.4 there were no servo settings, and the rest of the EEPROM wasn't initialized
+		if ( Settings::get(Settings::SERVO_OPEN_DEGREES) > 180 )
+		{
+			for ( int i = Settings::SERVO_OPEN_DEGREES; i < Settings::SETTINGS_SIZE; ++i )
+				writeRaw(i, 0);
+
+			Settings::set(Settings::SERVO_CLOSED_DEGREES, 90);
+			Settings::set(Settings::SERVO_OPEN_DEGREES, 90);
+			Settings::set(Settings::BAKE_TEMP, BAKE_MIN_TEMP);
+		}
+		// Fall through ...
+
+	case 2:
+		// The run history is in EEPROM that wasn't used before
+		// Fall through ...
+
+	case 3:
+		// The run history was made smaller, to make room for the temp trace
+		History::clear();
+		// Fall through ...
+
+	default:
+		break;
+	}
+
+	// The header is written with the new version
+	headerChanged = true;
+}
+
+// Write the defaults, only writing the bytes that are different
+void writeDefaults(void)
+{
+	// Initialize all the settings to 0 (false)
+	for ( int i = 0; i < Settings::SETTINGS_SIZE; ++i )
+		EEPROM.update(i, 0);
+
+	load();
+
+	Settings::set(Settings::MAX_TEMP, 240); // Set a reasonable max temp
+	Settings::set(Settings::SERVO_CLOSED_DEGREES, 90); // Set the servos to neutral positions (90 degrees)
+	Settings::set(Settings::SERVO_OPEN_DEGREES, 90);
+	Settings::set(Settings::BAKE_TEMP, BAKE_MIN_TEMP); // Set default baking temp
+
+	headerChanged = true;
+	Settings::flush();
+}
+
+} // namespace
+
+void Settings::ensureInitialized(void)
+{
+	Header header;
+
+	load();
+	EEPROM.get(SETTINGS_SIZE, header);
+
+	if ( header.magic != SETTINGS_MAGIC )
+	{
+		// Erased EEPROM is all 0xFF, so EEPROM_NEEDS_INIT is set
+		if ( get(EEPROM_NEEDS_INIT) )
+			restoreDefaults();
+		else
+			upgrade(1);
+	}
+	else if ( (header.crc[0] != loadedCrc && header.crc[1] != loadedCrc) || header.version > SETTINGS_VERSION )
+	{
+		// The journal and the history have their own CRCs, so they are kept
+		serialLog.println(F("Settings are corrupt.  Restoring the defaults"));
+		writeDefaults();
+	}
+	else
+	{
+		// Don't write over the copy of the CRC that matches
+		nextCopy = header.crc[0] == loadedCrc ? 1 : 0;
+
+		if ( header.version < SETTINGS_VERSION )
+			upgrade(header.version);
+	}
+
+	flush();
+}
+
+// Also used for a factory reset, which forgets what was learned and the run history too
+void Settings::restoreDefaults(void)
+{
+	Journal::clear();
+	History::clear();
+	writeDefaults();
+}
+
+// Called from the main loop.  Writes at most one byte: the settings first, then anything
+// posted to the journal.
+void Settings::writeBehind(void)
+{
+	if ( ! eeprom_is_ready() )
+		return;
+
+	if ( ! writeNext() )
+		Journal::writeBehind();
+}
+
+void Settings::flush(void)
+{
+	while ( writeNext() )
+		;
+
+	if ( headerChanged )
+	{
+		writeHeader();
+		headerChanged = false;
+	}
+
+	while ( Journal::writeBehind() )
+		;
+
+	writeJournal();
+}
+
+// Get the setting (from RAM)
 int Settings::get(int settingNum)
 {
-	int val(EEPROM.read(settingNum));
+	int val(readRaw(settingNum));
 
 	// The maximum temp has an offset to allow it to be saved in 8-bits (0 - 255)
 	if ( settingNum == MAX_TEMP )
@@ -58,8 +406,8 @@ int Settings::get(int settingNum)
 	return val;
 }
 
-// Save the setting to EEPROM.  EEPROM has limited write cycles, so don't save it if the
-// value hasn't changed.
+// Save the setting.  EEPROM has limited write cycles, so don't save it if the value hasn't
+// changed.  It is written to EEPROM later (see writeBehind).
 void Settings::set(int settingNum, int value)
 {
 	if ( get(settingNum) != value )
@@ -71,27 +419,33 @@ void Settings::set(int settingNum, int value)
 		case D6_TYPE:
 		case D7_TYPE:
 			// The element has been reconfigured so reset the duty cycles and restart learning
-			EEPROM.write(SETTINGS_CHANGED, true);
-			EEPROM.write(LEARNING_MODE, true);
-			EEPROM.write(settingNum, value);
-			Serial.println(F("Settings changed!  Duty cycles have been reset and learning mode has been enabled"));
+			writeRaw(SETTINGS_CHANGED, true);
+			writeRaw(LEARNING_MODE, true);
+			writeRaw(AUTOTUNE_GAIN, 0); // The oven model was for the old outputs
+			writeRaw(settingNum, value);
+			serialLog.println(F("Settings changed!  Duty cycles have been reset and learning mode has been enabled"));
 			break;
 
 		case MAX_TEMP:
 			// Enable learning mode if the maximum temp has changed a lot
 			if ( abs(get(settingNum) - value) > 5 )
-				EEPROM.write(LEARNING_MODE, true);
+				writeRaw(LEARNING_MODE, true);
 
 			// Write the new maximum temp
-			EEPROM.write(settingNum, value - TEMP_OFFSET);
+			writeRaw(settingNum, value - TEMP_OFFSET);
 			break;
 
 		case BAKE_TEMP:
-			EEPROM.write(settingNum, value / BAKE_TEMP_STEP);
+			writeRaw(settingNum, value / BAKE_TEMP_STEP);
+			break;
+
+		case TEMP_WINDOW:
+			writeRaw(settingNum, value);
+			setThermocoupleWindow(value);
 			break;
 
 		default:
-			EEPROM.write(settingNum, value);
+			writeRaw(settingNum, value);
 			break;
 		}
 	}
@@ -0,0 +1,168 @@
+// Telemetry
+// Reflow and bake data is normally written to the serial port as text, for humans.
+// For plotting and logging it can be sent as small binary frames instead (see
+// TelemetryFormat.h).  A frame takes a fraction of the time and stack of formatting
+// the text, and host/TelemetryDecode turns the frames back into CSV.
+//
+// Serial commands select the mode (see SerialCommands.cpp):
+//   a  Text (the default)
+//   b  Binary, every sample
+//   B  Binary, with a deadband.  A sample is only sent if the temp has moved by at
+//      least DEADBAND, something else in it has changed, or HEARTBEAT_MS has passed.
+
+#include <Arduino.h>
+#include "ReflowWizard.h"
+#include "TelemetryFormat.h"
+
+#define DEADBAND     2      // Quarter degrees (0.5C)
+#define HEARTBEAT_MS 10000UL
+
+namespace {
+
+uint8_t mode(Telemetry::TEXT);
+uint8_t sequence;
+uint8_t frame[TELEMETRY_MAX_PAYLOAD + 4];
+uint8_t length;
+
+// The last sample sent, for the deadband
+uint8_t lastSample[TELEMETRY_SAMPLE_LENGTH];
+bool haveLastSample;
+uint32_t lastSampleTime;
+
+void put8(uint8_t value)
+{
+	frame[2 + length++] = value;
+}
+
+void put16(uint16_t value)
+{
+	put8(value & 0xFF);
+	put8(value >> 8);
+}
+
+void put32(uint32_t value)
+{
+	put16(value & 0xFFFF);
+	put16(value >> 16);
+}
+
+void startFrame(uint8_t type)
+{
+	length = 0;
+	put8(type);
+	put8(0); // The sequence number is filled in when the frame is sent
+}
+
+void putDuty(const int duty[4])
+{
+	for ( int i = 0; i < 4; ++i )
+		put8(duty ? duty[i] : 0);
+}
+
+void sendFrame(void)
+{
+	frame[0] = TELEMETRY_SYNC;
+	frame[1] = length;
+	frame[3] = sequence++;
+
+	uint16_t crc(0xFFFF);
+
+	for ( uint8_t i = 1; i < length + 2; ++i )
+		crc = telemetryCrc(crc, frame[i]);
+
+	frame[2 + length] = crc & 0xFF;
+	frame[3 + length] = crc >> 8;
+
+	// One write, so the frame is logged whole or not at all (see SerialLog.cpp)
+	serialLog.write(frame, length + 4);
+}
+
+// Is the sample in the frame worth sending?
+bool passesDeadband(uint32_t now)
+{
+	if ( mode != Telemetry::BINARY_DEADBAND || ! haveLastSample || now - lastSampleTime >= HEARTBEAT_MS )
+		return true;
+
+	const uint8_t *sample(&frame[2]);
+	const int temp((int16_t) (sample[SAMPLE_TEMP] | (sample[SAMPLE_TEMP + 1] << 8)));
+	const int lastTemp((int16_t) (lastSample[SAMPLE_TEMP] | (lastSample[SAMPLE_TEMP + 1] << 8)));
+
+	if ( abs(temp - lastTemp) >= DEADBAND )
+		return true;
+
+	// The time and seconds always change, and the outputs change every few ticks.
+	// Anything else changing is worth sending.
+	return memcmp(&sample[SAMPLE_SOURCE], &lastSample[SAMPLE_SOURCE], 2)
+		|| memcmp(&sample[SAMPLE_DUTY], &lastSample[SAMPLE_DUTY], 4)
+		|| memcmp(&sample[SAMPLE_TERM], &lastSample[SAMPLE_TERM], 6);
+}
+
+} // namespace
+
+void Telemetry::setMode(int newMode)
+{
+	mode = newMode;
+	haveLastSample = false;
+}
+
+bool Telemetry::isBinary(void)
+{
+	return mode != TEXT;
+}
+
+// Send a sample (binary modes only)
+void Telemetry::sample(uint8_t source, uint8_t phase, int temp, const int duty[4]
+	, uint16_t seconds, int term0, int term1, int term2)
+{
+	const uint32_t now(millis());
+	uint8_t outputs(0);
+
+	for ( int i = 0; i < 4; ++i )
+	{
+		if ( digitalRead(4 + i) )
+			outputs |= 1 << i;
+	}
+
+	startFrame(TELEMETRY_SAMPLE);
+	put32(now);
+	put8(source);
+	put8(phase);
+	put16(temp);
+	put8(outputs);
+	putDuty(duty);
+	put16(seconds);
+	put16(term0);
+	put16(term1);
+	put16(term2);
+
+	if ( ! passesDeadband(now) )
+		return;
+
+	memcpy(lastSample, &frame[2], TELEMETRY_SAMPLE_LENGTH);
+	haveLastSample = true;
+	lastSampleTime = now;
+	sendFrame();
+}
+
+// A reflow phase has started (binary modes only)
+void Telemetry::phase(uint8_t phase, int endTemp, int minDuration, int maxDuration, const int duty[4])
+{
+	startFrame(TELEMETRY_PHASE);
+	put8(phase);
+	put16(endTemp);
+	put16(minDuration);
+	put16(maxDuration);
+	putDuty(duty);
+	sendFrame();
+}
+
+// A learned duty cycle has been changed (binary modes only)
+void Telemetry::dutyChanged(uint8_t phase, uint8_t output, int from, int to)
+{
+	startFrame(TELEMETRY_DUTY);
+	put8(phase);
+	put8(output);
+	put8(from);
+	put8(to);
+	sendFrame();
+}
@@ -0,0 +1,78 @@
+#pragma once
+// Binary telemetry frame format
+// Shared by the firmware (Telemetry.cpp) and the host decoder (host/decoder/TelemetryDecode.cpp)
+//
+// Frame:   SYNC, LENGTH, payload (LENGTH bytes), CRC (2 bytes, low byte first)
+// Payload: TYPE, SEQUENCE, then the fields for the type
+//
+// SEQUENCE goes up by one for every frame, so the decoder can tell if frames were lost.
+// The CRC is CRC-16/MCRF4XX (polynomial 0x1021 reflected, i.e. 0x8408, starting at 0xFFFF, no
+// final XOR; avr-libc's _crc_ccitt_update), over LENGTH and the payload.  Multi-byte values are little endian.
+// Text written to the serial port by the rest of the firmware can appear between frames.
+
+#include <stdint.h>
+
+#define TELEMETRY_SYNC        0xA5
+#define TELEMETRY_MAX_PAYLOAD 32
+
+// Frame types
+enum {
+	TELEMETRY_SAMPLE = 1 // Once per second while reflowing or baking
+	, TELEMETRY_PHASE    // A reflow phase has started
+	, TELEMETRY_DUTY     // A learned duty cycle was changed
+};
+
+// TELEMETRY_SAMPLE sources
+enum {
+	TELEMETRY_REFLOW = 1
+	, TELEMETRY_BAKE
+	, TELEMETRY_AUTOTUNE
+};
+
+// TELEMETRY_SAMPLE fields
+//   uint32_t time      millis()
+//   uint8_t  source    TELEMETRY_REFLOW, TELEMETRY_BAKE or TELEMETRY_AUTOTUNE
+//   uint8_t  phase     reflow or bake phase number
+//   int16_t  temp      quarter degrees C
+//   uint8_t  outputs   bit 0 = D4 ... bit 3 = D7, set if the output is on
+//   uint8_t  duty[4]   duty cycle (0-100) of D4 to D7
+//   uint16_t seconds   bake: time remaining.  reflow: time in this phase
+//   int16_t  term[3]   controller terms (bake: P, I and D, in 1/256ths of a percent.
+//                      reflow following the curve: target temp in quarter degrees, P and I in percent.
+//                      autotune: test temp in quarter degrees and the relay cycle)
+#define TELEMETRY_SAMPLE_LENGTH 23
+
+// Where the TELEMETRY_SAMPLE fields are in the payload
+enum {
+	SAMPLE_TIME = 2
+	, SAMPLE_SOURCE = 6
+	, SAMPLE_PHASE = 7
+	, SAMPLE_TEMP = 8
+	, SAMPLE_OUTPUTS = 10
+	, SAMPLE_DUTY = 11
+	, SAMPLE_SECONDS = 15
+	, SAMPLE_TERM = 17
+};
+
+// TELEMETRY_PHASE fields
+//   uint8_t  phase
+//   int16_t  endTemp      degrees C
+//   int16_t  minDuration  seconds
+//   int16_t  maxDuration  seconds
+//   uint8_t  duty[4]
+#define TELEMETRY_PHASE_LENGTH 13
+
+// TELEMETRY_DUTY fields
+//   uint8_t  phase
+//   uint8_t  output  0 = D4 ... 3 = D7
+//   uint8_t  from
+//   uint8_t  to
+#define TELEMETRY_DUTY_LENGTH 6
+
+inline uint16_t telemetryCrc(uint16_t crc, uint8_t data)
+{
+	data ^= crc & 0xFF;
+	data ^= data << 4;
+
+	return (((uint16_t) data << 8) | (crc >> 8)) ^ (uint8_t) (data >> 4) ^ ((uint16_t) data << 3);
+}
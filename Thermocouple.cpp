@@ -4,35 +4,116 @@
 // short-to-vcc errors.  This will help to eliminate those.
 // takeCurrentThermocoupleReading() is called from the Timer 1 interrupt (see "Servo" tab).  It is
 // called 5 times per second.
+// Temps are kept in quarters of a degree (see TEMP_SCALE), so no floating point is used.
+//
+// Each reading goes through two filters:
+// 1. Median of 3.  A single spike (e.g. from a convection fan) is thrown away completely,
+//    instead of moving the average by 1/5 of its size.  This delays changes by one reading.
+// 2. Average over the window (Settings::TEMP_WINDOW readings).  A running sum is kept, so
+//    the cost doesn't depend on the window length.
+//
+// After each reading the interrupt publishes the result (temp, fault and time) with a
+// sequence lock, so the main loop can read it without turning interrupts off.  Turning
+// them off would delay the Timer 1 interrupt, and that shows up as servo jitter.
 
 #include <Arduino.h>
 #include <ControLeo2.h>
 #include "ReflowWizard.h"
 
-#define NUM_READINGS     5   // Number of readings to average the temp over (5 readings = 1 second)
-#define ERROR_THRESHOLD 15  // Number of consecutive faults before a fault is returned
+#define MAX_READINGS     16  // Longest window (16 readings = 3.2 seconds)
+#define DEFAULT_READINGS  5  // Default window (5 readings = 1 second)
+#define ERROR_THRESHOLD  15  // Number of consecutive faults before a fault is returned
+#define SPIKE_LIMIT TEMP_C(5) // A reading this far from the median is counted as a spike
 
-// Store the temps as they are read
-volatile double recentTemps[NUM_READINGS];
+ControLeo2::MAX31855 thermocouple;
+
+namespace {
+
+// Store the filtered temps as they are read
+volatile int recentTemps[MAX_READINGS];
+volatile long tempSum;                       // Sum of the temps in the window
+volatile uint8_t windowSize(DEFAULT_READINGS);
+volatile uint8_t readingNum;                 // Where the next temp goes in recentTemps
+int previousRaw[2];                          // The last two readings, for the median
+bool primed;                                 // Has the window been filled?
 volatile int tempFaultCount;
 volatile int tempFault;
-ControLeo2::MAX31855 thermocouple;
 
-// This function is called every 200ms from the Timer 1 (servo) interrupt
-void takeCurrentThermocoupleReading(void)
+// Statistics, since they were last reset
+volatile uint16_t readingCount;
+volatile uint16_t spikeCount;
+volatile uint16_t faultCount[4];             // Indexed by fault (1 = open, 2 = GND, 3 = VCC)
+volatile uint16_t longestFaultRun;
+volatile uint16_t faultRun;
+volatile uint16_t recentFaultBits;           // One bit per reading (most recent in bit 0), set for faults
+
+// The published result.  publishSeq is odd while the interrupt is writing it.
+volatile uint8_t publishSeq;
+volatile int publishedTemp;
+volatile uint8_t publishedFault;
+volatile uint32_t publishedTime;
+
+int median(int a, int b, int c)
 {
-	volatile static int readingNum;
+	if ( a > b )
+	{
+		int t(a);
+		a = b;
+		b = t;
+	}
 
-	// The timer has fired.  It has been 0.2 seconds since the previous reading was taken
-	// Take a thermocouple reading
-	double temp(9999.9);
+	// a <= b
+	if ( c <= a )
+		return a;
 
-	if ( thermocouple.readThermocouple(temp) )
+	return c < b ? c : b;
+}
+
+// Fill the window with one temp (interrupts must be off)
+void fillWindow(int temp)
+{
+	for ( int i = 0; i < windowSize; ++i )
+		recentTemps[i] = temp;
+
+	tempSum = (long) temp * windowSize;
+	readingNum = 0;
+}
+
+// Add a reading to the filters (called from the interrupt)
+void takeReading(bool ok, int raw)
+{
+	recentFaultBits = (recentFaultBits << 1) | (ok ? 0 : 1);
+
+	if ( ok )
 	{
-		recentTemps[readingNum] = temp;
-		readingNum = (readingNum + 1) % NUM_READINGS;
+		++readingCount;
 		// Clear any previous error
 		tempFaultCount = 0;
+		faultRun = 0;
+
+		// Start with the window full of this reading, rather than ramping up from 0
+		if ( ! primed )
+		{
+			primed = true;
+			previousRaw[0] = previousRaw[1] = raw;
+			fillWindow(raw);
+			return;
+		}
+
+		const int temp(median(previousRaw[0], previousRaw[1], raw));
+
+		previousRaw[0] = previousRaw[1];
+		previousRaw[1] = raw;
+
+		if ( abs(raw - temp) > SPIKE_LIMIT )
+			++spikeCount;
+
+		// Replace the oldest temp in the window
+		tempSum += temp - recentTemps[readingNum];
+		recentTemps[readingNum] = temp;
+
+		if ( ++readingNum >= windowSize )
+			readingNum = 0;
 	}
 	else // error
 	{
@@ -42,36 +123,191 @@ void takeCurrentThermocoupleReading(void)
 		 */
 		if ( tempFaultCount < ERROR_THRESHOLD )
 			++tempFaultCount;
+		else
+			primed = false; // The temps in the window are stale.  Start again once the fault clears
 
 		tempFault = thermocouple.getFault();
+		++faultCount[tempFault & 0x03];
+
+		if ( ++faultRun > longestFaultRun )
+			longestFaultRun = faultRun;
 	}
 }
 
+// Publish the current result (called from the interrupt)
+// The main loop can't run while this runs, but the sequence number still tells it
+// whether a new reading was published while it was copying the last one.
+void publish(void)
+{
+	int temp(TEMP_FAULT);
+	uint8_t fault(0);
+
+	if ( tempFaultCount < ERROR_THRESHOLD ) // Average, rounded to the nearest quarter degree
+		temp = (tempSum + (tempSum < 0 ? -windowSize / 2 : windowSize / 2)) / windowSize;
+	else
+		fault = tempFault;
+
+	++publishSeq;
+	publishedTemp = temp;
+	publishedFault = fault;
+	publishedTime = millis();
+	++publishSeq;
+}
+
+} // namespace
+
+// This function is called every 200ms from the Timer 1 (servo) interrupt
+void takeCurrentThermocoupleReading(void)
+{
+	// The timer has fired.  It has been 0.2 seconds since the previous reading was taken
+	// Take a thermocouple reading
+	int16_t raw;
+	const bool ok(thermocouple.readQuarterDegrees(raw));
+
+	takeReading(ok, raw);
+	publish();
+}
+
+// Get the latest result published by the interrupt, without turning interrupts off
+// If the interrupt published a new one part way through, copy it again
+void getTempSnapshot(TempSnapshot &snapshot)
+{
+	uint8_t seq;
+
+	do
+	{
+		seq = publishSeq;
+		snapshot.temp = publishedTemp;
+		snapshot.fault = publishedFault;
+		snapshot.time = publishedTime;
+	} while ( (seq & 1) || seq != publishSeq );
+
+	snapshot.sequence = seq >> 1;
+}
+
 // Routine used by the main app to get temps
-// This routine disables and then re-enables interrupts so that data corruption isn't caused
-// by the ISR writing data at the same time it is read here.
-int getCurrentTemp(double &target)
+int getCurrentTemp(int &target)
+{
+	TempSnapshot snapshot;
+
+	getTempSnapshot(snapshot);
+	target = snapshot.temp;
+
+	return snapshot.fault;
+}
+
+// Set the number of readings to average over (0 = the default)
+// The window is refilled with the current average, so the temp doesn't jump
+void setThermocoupleWindow(int readings)
 {
-	target = 0.0;
-	int rc(0);
+	if ( readings <= 0 )
+		readings = DEFAULT_READINGS;
+
+	if ( readings > MAX_READINGS )
+		readings = MAX_READINGS;
 
 	noInterrupts();
 
-	if ( tempFaultCount < ERROR_THRESHOLD )
-	{
-		for ( int i = 0; i < NUM_READINGS; ++i )
-			target += recentTemps[i];
+	const int average(tempSum / windowSize);
 
-		target /= NUM_READINGS;
-	}
-	else
+	windowSize = readings;
+
+	if ( primed )
+		fillWindow(average);
+
+	interrupts();
+}
+
+// Print a temp in quarter degrees as degrees, like print(double) does (e.g. "183.25")
+void printTemp(Print &out, int temp)
+{
+	if ( temp < 0 )
 	{
-		target = 9999.9;
-		rc = tempFault;
+		out.print('-');
+		temp = -temp;
 	}
 
+	out.print(temp / TEMP_SCALE);
+	out.print('.');
+
+	const int hundredths((temp % TEMP_SCALE) * (100 / TEMP_SCALE));
+
+	if ( hundredths < 10 )
+		out.print('0');
+
+	out.print(hundredths);
+}
+
+// Faulty readings in the current window
+int ThermocoupleStats::recentFaults(void)
+{
+	noInterrupts();
+	uint16_t bits(recentFaultBits);
+	const uint8_t readings(windowSize);
 	interrupts();
 
-	return rc;
+	if ( readings < 16 )
+		bits &= (1U << readings) - 1;
+
+	int faults(0);
+
+	for ( ; bits; bits &= bits - 1 )
+		++faults;
+
+	return faults;
+}
+
+void ThermocoupleStats::counts(uint16_t &faults, uint16_t &spikes)
+{
+	noInterrupts();
+	faults = faultCount[1] + faultCount[2] + faultCount[3];
+	spikes = spikeCount;
+	interrupts();
 }
 
+void ThermocoupleStats::reset(void)
+{
+	noInterrupts();
+	readingCount = 0;
+	spikeCount = 0;
+	longestFaultRun = faultRun;
+
+	for ( int i = 0; i < 4; ++i )
+		faultCount[i] = 0;
+
+	interrupts();
+}
+
+void ThermocoupleStats::dump(void)
+{
+	uint16_t counts[7];
+
+	// Take a copy, so the numbers are from the same moment
+	noInterrupts();
+	counts[0] = windowSize;
+	counts[1] = readingCount;
+	counts[2] = spikeCount;
+	counts[3] = faultCount[1];
+	counts[4] = faultCount[2];
+	counts[5] = faultCount[3];
+	counts[6] = longestFaultRun;
+	interrupts();
+
+	serialLog.print(F("Thermocouple: window="));
+	serialLog.print(counts[0]);
+	serialLog.print(F(" readings="));
+	serialLog.print(counts[1]);
+	serialLog.print(F(" spikes="));
+	serialLog.println(counts[2]);
+
+	serialLog.print(F("  faults: open="));
+	serialLog.print(counts[3]);
+	serialLog.print(F(" gnd="));
+	serialLog.print(counts[4]);
+	serialLog.print(F(" vcc="));
+	serialLog.print(counts[5]);
+	serialLog.print(F(" longest run="));
+	serialLog.print(counts[6]);
+	serialLog.print(F(" in window="));
+	serialLog.println(recentFaults());
+}
@@ -0,0 +1,397 @@
+// Temp trace
+// The temp and the outputs of the last run, once a second, so a run that went wrong can be
+// looked at afterwards without a PC having been connected ("c" serial command, as CSV).
+//
+// The samples are recorded in RAM while the run goes, and written to the EEPROM with the run
+// history at the end of the run (see History.cpp, which drives the recording).  To fit, each
+// sample is stored as the change from the one before, as a variable length number:
+// - A token is a number in 7 bit groups, lowest first, with the top bit set on all but the last.
+// - If bit 0 is set, the rest is the number of samples that were the same as the last, less 1.
+// - Otherwise bits 2 and up are the temp change (quarter degrees, zigzag encoded so small
+//   negative changes are small numbers too).  If bit 1 is set, a byte with the outputs that
+//   are on (bit 0 = D4) follows.
+// A sample takes a byte or so, so the first couple of minutes fit at one a second.  When the
+// buffer is full, pairs of samples are merged into one and the sample interval doubles, so a
+// reflow or a long bake still fits (more coarsely).  A reflow stops being recorded once it has
+// cooled below liquidus (about 4 seconds a sample by then).
+
+#include <Arduino.h>
+#include <EEPROM.h>
+#include "ReflowWizard.h"
+
+namespace {
+
+#define TRACE_START    544 // After the run history (see History.cpp), up to the journal
+#define TRACE_SIZE     216 // Bytes of samples (the header takes the rest)
+#define TOKEN_MAX        8 // Room to leave for the next sample and a pending run of samples
+#define DUMP_LINE_SIZE  40 // Room needed in the serial log for a line of the dump
+
+struct Header
+{
+	uint16_t run;      // The run number (see History.cpp).  0 = no trace.
+	int16_t startTemp; // Quarter degrees
+	uint16_t length;   // Bytes of samples
+	uint8_t interval;  // Seconds between samples
+	uint8_t crc;       // Of the header before it, then the samples
+};
+
+// Turns the tokens back into samples
+struct Reader
+{
+	int pos;
+	int length;
+	unsigned int repeats; // Samples left in a run of the same
+	uint8_t outputs;
+};
+
+// Turns samples into tokens.  A run of the same samples is only written when it ends.
+struct Writer
+{
+	int pos;
+	unsigned int repeats;
+	uint8_t outputs;
+};
+
+uint8_t samples[TRACE_SIZE];
+Writer writer;
+bool isRecording;
+int startTemp;
+int lastTemp;        // The temp of the last sample recorded
+uint8_t interval;    // Seconds between samples
+uint8_t secondsToNext;
+
+// The dump, read straight from the EEPROM (not through samples, which may hold a run that
+// hasn't been saved yet)
+Reader dumpReader;
+bool isDumping;
+int dumpTemp;
+uint16_t dumpSeconds;
+uint8_t dumpInterval;
+
+unsigned int zigzag(int n)
+{
+	return n < 0 ? ((unsigned int) -n << 1) - 1 : (unsigned int) n << 1;
+}
+
+int unzigzag(unsigned int n)
+{
+	return n & 1 ? -(int) ((n + 1) >> 1) : (int) (n >> 1);
+}
+
+void writeToken(uint8_t *data, int &pos, unsigned long token)
+{
+	while ( token >= 0x80 )
+	{
+		data[pos++] = token | 0x80;
+		token >>= 7;
+	}
+
+	data[pos++] = token;
+}
+
+// A byte of samples, from RAM or (if data is NULL) the saved trace in EEPROM
+uint8_t readByte(const uint8_t *data, int pos)
+{
+	return data ? data[pos] : EEPROM.read(TRACE_START + sizeof(Header) + pos);
+}
+
+unsigned long readToken(const uint8_t *data, int &pos)
+{
+	unsigned long token(0);
+	int shift(0);
+	uint8_t b;
+
+	do
+	{
+		b = readByte(data, pos++);
+		token |= (unsigned long) (b & 0x7F) << shift;
+		shift += 7;
+	} while ( b & 0x80 );
+
+	return token;
+}
+
+void flushRepeats(uint8_t *data, Writer &w)
+{
+	if ( w.repeats )
+	{
+		writeToken(data, w.pos, ((unsigned long) (w.repeats - 1) << 1) | 1);
+		w.repeats = 0;
+	}
+}
+
+void writeSample(uint8_t *data, Writer &w, int change, uint8_t outputs)
+{
+	if ( ! change && outputs == w.outputs )
+	{
+		++w.repeats;
+		return;
+	}
+
+	flushRepeats(data, w);
+
+	const bool outputsChanged(outputs != w.outputs);
+
+	writeToken(data, w.pos, ((unsigned long) zigzag(change) << 2) | (outputsChanged ? 2 : 0));
+
+	if ( outputsChanged )
+		data[w.pos++] = outputs;
+
+	w.outputs = outputs;
+}
+
+// False at the end
+bool readSample(const uint8_t *data, Reader &r, int &change)
+{
+	change = 0;
+
+	if ( r.repeats )
+	{
+		--r.repeats;
+		return true;
+	}
+
+	if ( r.pos >= r.length )
+		return false;
+
+	const unsigned long token(readToken(data, r.pos));
+
+	if ( token & 1 )
+	{
+		r.repeats = token >> 1; // This sample is the first of them
+		return true;
+	}
+
+	change = unzigzag(token >> 2);
+
+	if ( token & 2 )
+		r.outputs = readByte(data, r.pos++);
+
+	return true;
+}
+
+// Halve the sample rate, by merging each pair of samples into one (the temp change of both,
+// and the outputs of the second).  This is done in place: the merged tokens are never longer
+// than the ones they came from, so the writing stays behind the reading.
+//
+// A sample is at second n * interval + interval - 1 (the last second of the ones it covers),
+// which stays true for the merged samples.  An odd one at the end doesn't have a pair, so it
+// is dropped, and its temp change goes with the next sample.  Returns false if there wasn't
+// one, when the next sample is due in (the old) interval seconds.
+bool halveRate(void)
+{
+	Reader r = { 0, writer.pos, 0, 0 };
+	Writer w = { 0, 0, 0 };
+	int first, second;
+	bool isOdd(false);
+
+	flushRepeats(samples, writer);
+	r.length = writer.pos;
+
+	while ( readSample(samples, r, first) )
+	{
+		if ( ! readSample(samples, r, second) )
+		{
+			lastTemp -= first;
+			isOdd = true;
+			break;
+		}
+
+		writeSample(samples, w, first + second, r.outputs);
+	}
+
+	flushRepeats(samples, w);
+	writer = w;
+	interval *= 2;
+
+	return isOdd;
+}
+
+uint8_t outputsOn(void)
+{
+	uint8_t outputs(0);
+
+	for ( int i = 0; i < 4; ++i )
+	{
+		if ( digitalRead(4 + i) )
+			outputs |= 1 << i;
+	}
+
+	return outputs;
+}
+
+// CRC-8 (polynomial 0x31), as in the journal, carried on from crc
+uint8_t crc8(uint8_t crc, const uint8_t *p, int length)
+{
+	while ( length-- )
+	{
+		crc ^= *p++;
+
+		for ( int i = 0; i < 8; ++i )
+			crc = crc & 0x80 ? (crc << 1) ^ 0x31 : crc << 1;
+	}
+
+	return crc;
+}
+
+// Of the header and the samples (from RAM or, if data is NULL, the EEPROM)
+uint8_t traceCrc(const Header &h, const uint8_t *data)
+{
+	uint8_t crc(crc8(0xFF, (const uint8_t *) &h, sizeof(h) - 1));
+
+	for ( int i = 0; i < h.length; ++i )
+	{
+		const uint8_t b(readByte(data, i));
+
+		crc = crc8(crc, &b, 1);
+	}
+
+	return crc;
+}
+
+// Read the header of the saved trace.  False if there isn't a good one.
+bool readHeader(Header &h)
+{
+	EEPROM.get(TRACE_START, h);
+
+	if ( ! h.run || h.length > TRACE_SIZE || ! h.interval )
+		return false;
+
+	return h.crc == traceCrc(h, NULL);
+}
+
+} // namespace
+
+void Trace::start(void)
+{
+	writer.pos = 0;
+	writer.repeats = 0;
+	writer.outputs = 0;
+	interval = 1;
+	secondsToNext = 0;
+	startTemp = TEMP_FAULT;
+	isRecording = true;
+}
+
+// Called once a second
+void Trace::sample(int temp)
+{
+	if ( ! isRecording || secondsToNext-- )
+		return;
+
+	secondsToNext = interval - 1;
+
+	if ( startTemp == TEMP_FAULT )
+		startTemp = lastTemp = temp;
+
+	if ( writer.pos > TRACE_SIZE - TOKEN_MAX )
+	{
+		// Make room.  (Very long bakes just stop being recorded.)
+		if ( interval >= 128 )
+		{
+			isRecording = false;
+			return;
+		}
+
+		if ( ! halveRate() )
+		{
+			secondsToNext = interval / 2 - 1;
+			return;
+		}
+
+		secondsToNext = interval - 1;
+	}
+
+	writeSample(samples, writer, temp - lastTemp, outputsOn());
+	lastTemp = temp;
+}
+
+void Trace::stop(void)
+{
+	isRecording = false;
+}
+
+// Write the trace to the EEPROM (waits for it)
+void Trace::save(uint16_t run)
+{
+	Header h;
+
+	if ( startTemp == TEMP_FAULT )
+		return;
+
+	flushRepeats(samples, writer);
+
+	h.run = run;
+	h.startTemp = startTemp;
+	h.length = writer.pos;
+	h.interval = interval;
+	h.crc = traceCrc(h, samples);
+
+	// A dump of the old trace can't carry on
+	isDumping = false;
+	EEPROM.put(TRACE_START, h);
+
+	for ( int i = 0; i < h.length; ++i )
+		EEPROM.update(TRACE_START + sizeof(h) + i, samples[i]);
+
+	startTemp = TEMP_FAULT;
+}
+
+void Trace::clear(void)
+{
+	EEPROM.put(TRACE_START, (uint16_t) 0);
+}
+
+// Show the saved trace as CSV.  It is sent a few lines per main loop (see dumpNext), so it
+// doesn't overflow the serial log.
+void Trace::dump(void)
+{
+	Header h;
+
+	if ( ! readHeader(h) )
+	{
+		serialLog.println(F("No temp trace"));
+		return;
+	}
+
+	serialLog.print(F("Temp trace of run "));
+	serialLog.println(h.run);
+	serialLog.println(F("Seconds, Temp, D4, D5, D6, D7"));
+
+	dumpReader.pos = 0;
+	dumpReader.length = h.length;
+	dumpReader.repeats = 0;
+	dumpReader.outputs = 0;
+	dumpTemp = h.startTemp;
+	dumpSeconds = h.interval - 1;
+	dumpInterval = h.interval;
+	isDumping = true;
+}
+
+void Trace::dumpNext(void)
+{
+	int change;
+
+	if ( ! isDumping )
+		return;
+
+	while ( serialLog.space() >= DUMP_LINE_SIZE )
+	{
+		if ( ! readSample(NULL, dumpReader, change) )
+		{
+			isDumping = false;
+			return;
+		}
+
+		dumpTemp += change;
+		serialLog.print(dumpSeconds);
+		serialLog.print(F(", "));
+		printTemp(serialLog, dumpTemp);
+
+		for ( int i = 0; i < 4; ++i )
+			serialLog.print(dumpReader.outputs & (1 << i) ? F(", 1") : F(", 0"));
+
+		serialLog.println();
+		dumpSeconds += dumpInterval;
+	}
+}
@@ -1,43 +1,126 @@
-// Play the selected tone
-// This is a synchronous (blocking) call.  The function doesn't return until the
-// tone has been played.  This works fine for this application, but it could be
-// done using a timer interrupt and a lot more (complicated) code.
+// Play the selected tune
+// This is an asynchronous (non-blocking) call.  Tunes::play() only selects the tune;
+// the notes are started from the Timer 1 interrupt (see Servo.cpp) which calls
+// Tunes::tick() every 20ms.  tone() stops each note by itself, so nothing waits.
+// Playing a tune stops the one that is currently playing.
+//
+// Tunes are stored in flash, one byte per note:
+//   bits 7-5: length code (see noteDivisor), 0 marks the end of the tune
+//   bits 4-0: pitch in semitones above B3 (1 = C4 ... 31 = F#6), 0 is a rest
 
+#include <Arduino.h>
 #include <ControLeo2.h>
 #include "ReflowWizard.h"
-#include "Notes.h"
+
+#include <avr/pgmspace.h>
 
 namespace {
 
-#define MAX_TUNES 5
+#define TICK_MS 20 // Tunes::tick() is called every 20ms
+
+// Pitches, in semitones above B3
+enum {
+	REST
+	, PITCH_C4, PITCH_CS4, PITCH_D4, PITCH_DS4, PITCH_E4, PITCH_F4
+	, PITCH_FS4, PITCH_G4, PITCH_GS4, PITCH_A4, PITCH_AS4, PITCH_B4
+	, PITCH_C5, PITCH_CS5, PITCH_D5, PITCH_DS5, PITCH_E5, PITCH_F5
+	, PITCH_FS5, PITCH_G5, PITCH_GS5, PITCH_A5, PITCH_AS5, PITCH_B5
+	, PITCH_C6, PITCH_CS6, PITCH_D6, PITCH_DS6, PITCH_E6, PITCH_F6, PITCH_FS6
+};
+
+// Note lengths: 4 = quarter note, 8 = eighth note, etc.
+enum { LEN_END, LEN_2, LEN_4, LEN_8, LEN_16, LEN_20, LEN_30, LEN_1 };
+
+const uint8_t noteDivisor[8] PROGMEM = {0, 2, 4, 8, 16, 20, 30, 1};
+
+#define NOTE(pitch, len) ((uint8_t) ((LEN_##len << 5) | (pitch)))
+#define END_OF_TUNE 0
+
+// Frequencies of the 5th octave.  Other octaves are found by shifting.
+const uint16_t octave5[12] PROGMEM = {523, 554, 587, 622, 659, 698, 740, 784, 831, 880, 932, 988};
 
 // Tunes used to indication various actions or status
-// an array containing alternating notes and note duration, terminated by -1
-const int tones[MAX_TUNES][17] = {
-	{NOTE_C5, 8, NOTE_G4, 8, -1} // TUNE_STARTUP
-	, {NOTE_F5, 30, -1} // TUNE_TOP_BUTTON_PRESS
-	, {NOTE_B5, 20, -1} // TUNE_BOTTOM_BUTTON_PRESS
-	, {NOTE_C5, 4, NOTE_G4, 8, NOTE_G4, 8, NOTE_A4, 4, NOTE_G4, 4, 0, 4, NOTE_B4, 4, NOTE_C5, 4, -1} // TUNE_REFLOW_DONE
-	, {NOTE_C5, 4, NOTE_B4, 4, NOTE_E4, 2, -1} // TUNE_REMOVE_BOARDS
+const uint8_t startupTune[] PROGMEM = {
+	NOTE(PITCH_C5, 8), NOTE(PITCH_G4, 8), END_OF_TUNE};
+const uint8_t topButtonPressTune[] PROGMEM = {
+	NOTE(PITCH_F5, 30), END_OF_TUNE};
+const uint8_t bottomButtonPressTune[] PROGMEM = {
+	NOTE(PITCH_B5, 20), END_OF_TUNE};
+const uint8_t reflowCompleteTune[] PROGMEM = {
+	NOTE(PITCH_C5, 4), NOTE(PITCH_G4, 8), NOTE(PITCH_G4, 8), NOTE(PITCH_A4, 4)
+	, NOTE(PITCH_G4, 4), NOTE(REST, 4), NOTE(PITCH_B4, 4), NOTE(PITCH_C5, 4), END_OF_TUNE};
+const uint8_t removeBoardsTune[] PROGMEM = {
+	NOTE(PITCH_C5, 4), NOTE(PITCH_B4, 4), NOTE(PITCH_E4, 2), END_OF_TUNE};
+
+// Indexed by Tunes::STARTUP etc.
+const uint8_t *const tunes[] PROGMEM = {
+	startupTune
+	, topButtonPressTune
+	, bottomButtonPressTune
+	, reflowCompleteTune
+	, removeBoardsTune
 };
 
+#define MAX_TUNES (sizeof(tunes) / sizeof(tunes[0]))
+
+// Player state, shared with the timer interrupt
+const uint8_t *volatile nextNote; // The next note to play (in flash), or NULL when idle
+volatile uint8_t ticksLeft;        // Ticks until the next note starts
+
+unsigned int pitchToFrequency(uint8_t pitch)
+{
+	uint8_t semitone(pitch - PITCH_C4);
+	unsigned int frequency(pgm_read_word(&octave5[semitone % 12]));
+
+	switch ( semitone / 12 )
+	{
+	case 0: return frequency >> 1;
+	case 1: return frequency;
+	default: return frequency << 1;
+	}
+}
+
 } // namespace
 
 void Tunes::play(int index)
 {
-	if ( index < MAX_TUNES )
+	if ( index < (int) MAX_TUNES )
 	{
-		const int *tonesToPlay(tones[index]);
+		noInterrupts();
+		nextNote = (const uint8_t *) pgm_read_ptr(&tunes[index]);
+		ticksLeft = 0; // Start on the next tick, replacing whatever is playing
+		interrupts();
+	}
+}
+
+// Called from the Timer 1 interrupt every 20ms
+void Tunes::tick(void)
+{
+	if ( ! nextNote )
+		return;
+
+	// Is the current note still playing?
+	if ( ticksLeft && --ticksLeft )
+		return;
 
-		for ( int i = 0; tonesToPlay[i] != -1; i += 2 )
-		{
-			// Note durations: 4 = quarter note, 8 = eighth note, etc.
-			int duration = 1000/tonesToPlay[i+1];
-			tone(CONTROLEO_BUZZER_PIN, tonesToPlay[i], duration);
-			delay(duration * 1.1);
-		}
+	uint8_t note(pgm_read_byte(nextNote));
 
+	if ( note == END_OF_TUNE )
+	{
 		noTone(CONTROLEO_BUZZER_PIN);
+		nextNote = NULL;
+		return;
 	}
-}
 
+	++nextNote;
+
+	unsigned int duration(1000 / pgm_read_byte(&noteDivisor[note >> 5]));
+
+	if ( note & 0x1F )
+		tone(CONTROLEO_BUZZER_PIN, pitchToFrequency(note & 0x1F), duration);
+	else
+		noTone(CONTROLEO_BUZZER_PIN);
+
+	// Leave a short gap (10% of the note) between notes
+	ticksLeft = (duration * 11 / 10 + TICK_MS - 1) / TICK_MS;
+}
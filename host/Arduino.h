@@ -0,0 +1,87 @@
+#pragma once
+// Host (Linux) emulation of the parts of the Arduino core used by ReflowWizard
+//
+// Time is virtual.  It only moves forward when the firmware waits (delay,
+// delayMicroseconds), touches a pin or writes the EEPROM, and the timer
+// interrupts are fired from the virtual clock.  This lets an 18 hour
+// bake run in a few seconds on a workstation.
+//
+// Note: int is 32-bits on the host (16-bits on the ATmega32U4)
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include <avr/pgmspace.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+#include "Print.h"
+
+#define HIGH 0x1
+#define LOW  0x0
+
+#define INPUT        0x0
+#define OUTPUT       0x1
+#define INPUT_PULLUP 0x2
+
+#define DEC 10
+#define HEX 16
+#define OCT 8
+#define BIN 2
+
+// Leonardo analog pin numbers
+#define A0 18
+#define A1 19
+#define A2 20
+#define A3 21
+#define A4 22
+#define A5 23
+
+#define NUM_DIGITAL_PINS 31
+
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+unsigned long millis(void);
+unsigned long micros(void);
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t val);
+int digitalRead(uint8_t pin);
+
+void tone(uint8_t pin, unsigned int frequency, unsigned long duration = 0);
+void noTone(uint8_t pin);
+
+long map(long x, long inMin, long inMax, long outMin, long outMax);
+
+#define interrupts() sei()
+#define noInterrupts() cli()
+
+// USB CDC serial port.  Output goes to stdout.
+class HostSerial : public Print
+{
+public:
+	void begin(unsigned long) {}
+	void end(void) {}
+	int available(void);
+	int read(void);
+	int peek(void);
+	int availableForWrite(void);
+	void flush(void);
+	virtual size_t write(uint8_t c);
+	virtual size_t write(const uint8_t *buffer, size_t size);
+	using Print::write;
+	operator bool(void) { return true; }
+};
+
+extern HostSerial Serial;
+
+void setup(void);
+void loop(void);
@@ -0,0 +1,39 @@
+#pragma once
+// Host (Linux) version of the Arduino EEPROM library
+// Like the ATmega32U4, there are 1024 bytes and a write takes 3.3ms
+
+#include <stdint.h>
+#include <avr/eeprom.h>
+
+#define E2END 0x3FF
+
+class EEPROMClass
+{
+public:
+	uint8_t read(int idx);
+	void write(int idx, uint8_t val);
+	void update(int idx, uint8_t val) { if ( read(idx) != val ) write(idx, val); }
+	uint16_t length(void) { return E2END + 1; }
+
+	template<typename T> T &get(int idx, T &t)
+	{
+		uint8_t *p((uint8_t *)&t);
+
+		for ( unsigned i = 0; i < sizeof(T); ++i )
+			p[i] = read(idx + i);
+
+		return t;
+	}
+
+	template<typename T> const T &put(int idx, const T &t)
+	{
+		const uint8_t *p((const uint8_t *)&t);
+
+		for ( unsigned i = 0; i < sizeof(T); ++i )
+			update(idx + i, p[i]);
+
+		return t;
+	}
+};
+
+extern EEPROMClass EEPROM;
@@ -0,0 +1,51 @@
+#pragma once
+// Internal interface between the pieces of the host (Linux) build
+//   HostCore.cpp    - virtual clock, timers, pins, EEPROM and serial port
+//   HostDevices.cpp - buttons, HD44780 LCD, MAX31855 and a thermal model of the oven
+//   HostMain.cpp    - command line handling and the setup()/loop() driver
+
+#include <stdint.h>
+
+namespace Host {
+
+// Virtual clock (nanoseconds since power on)
+uint64_t nowNs(void);
+void advanceNs(uint64_t ns);
+inline void advanceUs(uint64_t us) { advanceNs(us * 1000); }
+
+// Devices attached to the pins
+void pinWritten(uint8_t pin, uint8_t val);
+int pinRead(uint8_t pin, uint8_t latched);
+uint8_t pinState(uint8_t pin);
+
+// EEPROM image
+void eraseEeprom(void); // All 0xFF, like a freshly flashed part
+bool loadEeprom(const char *path);
+bool saveEeprom(const char *path);
+uint32_t eepromWrites(void);
+
+// Scripted user input
+void addButtonPress(uint32_t ms, uint8_t button, uint32_t holdMs);
+void addSerialInput(uint32_t ms, const char *text);
+int serialPeek(void); // Next character that has "arrived", or -1
+int serialRead(void);
+
+// Oven model
+struct OvenModel
+{
+	double ambient;    // Room temp (C)
+	double tau;        // Heat loss time constant (s)
+	double lag;        // Element warm-up time constant (s)
+	double noise;      // Peak thermocouple noise (C)
+	double power[6];   // Heating rate (C/s) at full power, indexed by output type
+};
+
+OvenModel &ovenModel(void);
+void setOvenTemp(double temp);
+double ovenTemp(void);
+
+// LCD
+bool lcdChanged(void);
+void lcdLine(int line, char *buf); // buf must hold 33 bytes (the degree symbol is UTF-8)
+
+} // namespace Host
@@ -0,0 +1,380 @@
+// Host (Linux) emulation of the Arduino core
+// Virtual clock, timer compare interrupts, digital pins, EEPROM and the serial port
+
+#include <Arduino.h>
+#include <EEPROM.h>
+#include "Host.h"
+
+#define PIN_ACCESS_NS    4000 // digitalWrite/digitalRead take about 4us on a 16MHz AVR
+#define EEPROM_WRITE_NS 3300000 // An EEPROM write takes 3.3ms
+#define USB_PACKET_SIZE 64
+#define TIMER0_COUNT_NS  4000 // Timer 0 counts at 250kHz (prescaler 64) for millis()
+#define TIMER0_PERIOD_NS (256 * TIMER0_COUNT_NS)
+
+volatile uint8_t OCR0A;
+volatile uint8_t TIMSK0;
+
+volatile uint8_t TCCR1A;
+volatile uint8_t TCCR1B;
+volatile uint16_t TCNT1;
+volatile uint16_t OCR1A;
+volatile uint16_t OCR1B;
+volatile uint8_t TIMSK1;
+
+HostSerial Serial;
+EEPROMClass EEPROM;
+
+namespace {
+
+uint64_t now;
+bool interruptsEnabled(true);
+bool inIsr;
+bool pendingCompA;
+bool pendingCompB;
+bool pendingComp0A;
+
+// Timer 0 state
+uint64_t lastComp0A;
+
+// Timer 1 state
+bool timerRunning;
+uint64_t periodStart;
+bool compBDone;
+
+uint8_t pins[NUM_DIGITAL_PINS];
+uint8_t eeprom[E2END + 1];
+uint32_t eepromWriteCount;
+uint64_t eepromReadyNs; // When the last write finishes
+
+// Serial output sent in the current USB frame (1ms)
+uint64_t usbFrame;
+size_t usbFrameBytes;
+
+// Convert Timer 1 counts to nanoseconds, using the prescaler in TCCR1B
+uint64_t timerCountsToNs(uint32_t counts)
+{
+	static const uint16_t prescaler[8] = {0, 1, 8, 64, 256, 1024, 0, 0};
+
+	return (uint64_t) counts * prescaler[TCCR1B & 0x07] * 1000 / 16;
+}
+
+void runIsr(void (*isr)(void))
+{
+	bool wasEnabled(interruptsEnabled);
+
+	// The AVR disables interrupts while an ISR runs
+	inIsr = true;
+	interruptsEnabled = false;
+	isr();
+	interruptsEnabled = wasEnabled;
+	inIsr = false;
+}
+
+void runPending(void)
+{
+	// Highest priority (lowest vector number) first
+	while ( interruptsEnabled && ! inIsr && (pendingCompA || pendingCompB || pendingComp0A) )
+	{
+		if ( pendingCompA )
+		{
+			pendingCompA = false;
+			runIsr(TIMER1_COMPA_vect);
+		}
+		else if ( pendingCompB )
+		{
+			pendingCompB = false;
+			runIsr(TIMER1_COMPB_vect);
+		}
+		else
+		{
+			pendingComp0A = false;
+			runIsr(TIMER0_COMPA_vect);
+		}
+	}
+}
+
+} // namespace
+
+namespace Host {
+
+uint64_t nowNs(void)
+{
+	return now;
+}
+
+// Move the virtual clock forward, firing the timer compare interrupts on the way
+void advanceNs(uint64_t ns)
+{
+	const uint64_t end(now + ns);
+
+	for ( ;; )
+	{
+		// Find the first interrupt that is due before the end
+		enum { NONE, COMP0A, COMP1A, COMP1B } source(NONE);
+		uint64_t at(end);
+
+		// Timer 0 free runs for millis(), so Compare A matches once per overflow period
+		if ( TIMSK0 & _BV(OCIE0A) )
+		{
+			uint64_t comp0A(now - now % TIMER0_PERIOD_NS + OCR0A * TIMER0_COUNT_NS);
+
+			if ( comp0A < now )
+				comp0A += TIMER0_PERIOD_NS;
+
+			if ( comp0A <= lastComp0A )
+				comp0A += TIMER0_PERIOD_NS;
+
+			if ( comp0A <= at )
+			{
+				at = comp0A;
+				source = COMP0A;
+			}
+		}
+
+		if ( (TCCR1B & 0x07) && (TIMSK1 & _BV(OCIE1A)) && OCR1A )
+		{
+			if ( ! timerRunning )
+			{
+				timerRunning = true;
+				periodStart = now;
+				compBDone = false;
+			}
+
+			// CTC mode: the counter is cleared on Compare A, Compare B fires part way through
+			const uint64_t compA(periodStart + timerCountsToNs(OCR1A + 1UL));
+			const uint64_t compB(periodStart + timerCountsToNs(OCR1B));
+
+			if ( ! compBDone && (TIMSK1 & _BV(OCIE1B)) && compB < compA && compB <= at )
+			{
+				at = compB;
+				source = COMP1B;
+			}
+			else if ( compA <= at )
+			{
+				at = compA;
+				source = COMP1A;
+			}
+		}
+		else
+			timerRunning = false;
+
+		if ( source == NONE )
+			break;
+
+		if ( now < at )
+			now = at;
+
+		switch ( source )
+		{
+		case COMP0A:
+			lastComp0A = at;
+			pendingComp0A = true;
+			break;
+
+		case COMP1A:
+			periodStart = at;
+			compBDone = false;
+			pendingCompA = true;
+			break;
+
+		default:
+			compBDone = true;
+			pendingCompB = true;
+			break;
+		}
+
+		runPending();
+	}
+
+	// Time may have moved past the end while an interrupt ran
+	if ( now < end )
+		now = end;
+}
+
+uint8_t pinState(uint8_t pin)
+{
+	return pin < NUM_DIGITAL_PINS ? pins[pin] : LOW;
+}
+
+void eraseEeprom(void)
+{
+	memset(eeprom, 0xFF, sizeof(eeprom));
+}
+
+bool loadEeprom(const char *path)
+{
+	FILE *fp(fopen(path, "rb"));
+
+	if ( ! fp )
+		return false;
+
+	bool ok(fread(eeprom, 1, sizeof(eeprom), fp) == sizeof(eeprom));
+	fclose(fp);
+	return ok;
+}
+
+bool saveEeprom(const char *path)
+{
+	FILE *fp(fopen(path, "wb"));
+
+	if ( ! fp )
+		return false;
+
+	bool ok(fwrite(eeprom, 1, sizeof(eeprom), fp) == sizeof(eeprom));
+	return fclose(fp) == 0 && ok;
+}
+
+uint32_t eepromWrites(void)
+{
+	return eepromWriteCount;
+}
+
+} // namespace Host
+
+void cli(void)
+{
+	interruptsEnabled = false;
+}
+
+void sei(void)
+{
+	interruptsEnabled = true;
+	runPending();
+}
+
+unsigned long millis(void)
+{
+	// Wrap at 32-bits, like the AVR
+	return (uint32_t) (now / 1000000);
+}
+
+unsigned long micros(void)
+{
+	return (uint32_t) (now / 1000);
+}
+
+void delay(unsigned long ms)
+{
+	Host::advanceNs((uint64_t) ms * 1000000);
+}
+
+void delayMicroseconds(unsigned int us)
+{
+	Host::advanceNs((uint64_t) us * 1000);
+}
+
+void pinMode(uint8_t pin, uint8_t mode)
+{
+	if ( pin < NUM_DIGITAL_PINS && mode == INPUT_PULLUP )
+		pins[pin] = HIGH;
+}
+
+void digitalWrite(uint8_t pin, uint8_t val)
+{
+	Host::advanceNs(PIN_ACCESS_NS);
+
+	if ( pin < NUM_DIGITAL_PINS )
+	{
+		val = val ? HIGH : LOW;
+
+		if ( pins[pin] != val )
+		{
+			Host::pinWritten(pin, val);
+			pins[pin] = val;
+		}
+	}
+}
+
+int digitalRead(uint8_t pin)
+{
+	Host::advanceNs(PIN_ACCESS_NS);
+
+	return Host::pinRead(pin, Host::pinState(pin));
+}
+
+void tone(uint8_t, unsigned int, unsigned long)
+{
+}
+
+void noTone(uint8_t)
+{
+}
+
+long map(long x, long inMin, long inMax, long outMin, long outMax)
+{
+	return (x - inMin) * (outMax - outMin) / (inMax - inMin) + outMin;
+}
+
+namespace {
+
+// Like the AVR, a write carries on in the background.  Reads and writes wait for it to finish.
+void eepromBusyWait(void)
+{
+	if ( now < eepromReadyNs )
+		Host::advanceNs(eepromReadyNs - now);
+}
+
+} // namespace
+
+bool eeprom_is_ready(void)
+{
+	return now >= eepromReadyNs;
+}
+
+uint8_t EEPROMClass::read(int idx)
+{
+	eepromBusyWait();
+	return eeprom[idx & E2END];
+}
+
+void EEPROMClass::write(int idx, uint8_t val)
+{
+	eepromBusyWait();
+	eeprom[idx & E2END] = val;
+	eepromReadyNs = now + EEPROM_WRITE_NS;
+	++eepromWriteCount;
+}
+
+size_t HostSerial::write(uint8_t c)
+{
+	++usbFrameBytes;
+	return fputc(c, stdout) == EOF ? 0 : 1;
+}
+
+size_t HostSerial::write(const uint8_t *buffer, size_t size)
+{
+	usbFrameBytes += size;
+	return fwrite(buffer, 1, size, stdout);
+}
+
+int HostSerial::available(void)
+{
+	return peek() >= 0 ? 1 : 0;
+}
+
+int HostSerial::read(void)
+{
+	return Host::serialRead();
+}
+
+int HostSerial::peek(void)
+{
+	return Host::serialPeek();
+}
+
+// The PC is always reading, and takes one 64 byte USB packet every millisecond
+int HostSerial::availableForWrite(void)
+{
+	if ( now / 1000000 != usbFrame )
+	{
+		usbFrame = now / 1000000;
+		usbFrameBytes = 0;
+	}
+
+	return USB_PACKET_SIZE - usbFrameBytes;
+}
+
+void HostSerial::flush(void)
+{
+	fflush(stdout);
+}
@@ -0,0 +1,360 @@
+// Host (Linux) emulation of the devices attached to ControLeo2
+//   - The two buttons, driven by a script of timed presses
+//   - The HD44780 LCD, decoded from its 4-bit bus into a 2x16 screen
+//   - The MAX31855 thermocouple amplifier, shifting out 32-bit frames
+//   - The oven itself, a simple thermal model heated by the relay outputs
+//
+// Because the devices are emulated at the pin level, the real ControLeo2
+// library is compiled and exercised on the host.
+
+#include <Arduino.h>
+#include <ControLeo2.h>
+#include <vector>
+#include <string>
+#include "ReflowWizard.h"
+#include "Host.h"
+
+namespace {
+
+// Buttons
+struct ButtonPress
+{
+	uint32_t ms;
+	uint8_t pin;
+	uint32_t holdMs;
+};
+
+std::vector<ButtonPress> buttonPresses;
+
+// Serial input
+struct SerialInput
+{
+	uint32_t ms;
+	std::string text;
+};
+
+std::vector<SerialInput> serialInputs;
+std::string serialBuffer;
+
+// LCD (pins from ControLeo2LiquidCrystal.cpp)
+#define LCD_RS_PIN A0
+#define LCD_EN_PIN A1
+#define LCD_D4_PIN A2
+
+bool lcdFourBit;
+bool lcdHaveHighNibble;
+uint8_t lcdHighNibble;
+bool lcdCgram;
+uint8_t lcdAddr;
+char lcdScreen[2][17] = { "                ", "                " };
+bool lcdDirty(true);
+
+// MAX31855 (pins from ControLeo2MAX31855.cpp)
+#define TC_MISO_PIN 8
+#define TC_CS_PIN   9
+#define TC_CLK_PIN 10
+
+uint32_t tcFrame;
+int tcBit;
+
+// Oven
+Host::OvenModel model = {
+	25.0     // ambient
+	, 400.0  // tau
+	, 25.0   // lag
+	, 0.0    // noise
+	, { 0.0, 1.0, 1.3, 0.6, 0.0, 0.0 } // unused, top, bottom, boost, convection fan, cooling fan
+};
+
+#define COOLING_FAN_LOSS 3.0 // The cooling fan triples heat loss
+#define OVEN_STEP_NS 10000000ULL // Integrate the oven model in 10ms steps
+
+double temp(25.0);
+double heat;
+uint64_t lastUpdate;
+uint32_t noiseSeed(1);
+
+int outputType(int output)
+{
+	int type(Settings::get(Settings::D4_TYPE + output));
+
+	return type < NO_OF_TYPES ? type : TYPE_UNUSED;
+}
+
+// Bring the oven model up to the current time, using the current state of the relay outputs
+void updateOven(void)
+{
+	const uint64_t now(Host::nowNs());
+	double power(0.0);
+	double loss(1.0);
+
+	for ( int i = 0; i < 4; ++i )
+	{
+		if ( Host::pinState(4 + i) == HIGH )
+		{
+			int type(outputType(i));
+
+			power += model.power[type];
+
+			if ( type == TYPE_COOLING_FAN )
+				loss = COOLING_FAN_LOSS;
+		}
+	}
+
+	while ( lastUpdate < now )
+	{
+		uint64_t stepNs(now - lastUpdate);
+
+		if ( stepNs > OVEN_STEP_NS )
+			stepNs = OVEN_STEP_NS;
+
+		const double dt(stepNs / 1e9);
+
+		heat += (power - heat) * dt / model.lag;
+		temp += (heat - loss * (temp - model.ambient) / model.tau) * dt;
+		lastUpdate += stepNs;
+	}
+}
+
+// Uniform noise in [-1, 1], repeatable from run to run
+double noise(void)
+{
+	noiseSeed = noiseSeed * 1103515245 + 12345;
+	return ((noiseSeed >> 8) & 0xFFFF) / 32767.5 - 1.0;
+}
+
+uint32_t thermocoupleFrame(void)
+{
+	updateOven();
+
+	long tc(lround((temp + model.noise * noise()) * 4.0));  // 0.25C per LSB
+	long junction(lround(model.ambient * 16.0));             // 0.0625C per LSB
+
+	return ((uint32_t) (tc & 0x3FFF) << 18) | ((uint32_t) (junction & 0xFFF) << 4);
+}
+
+void lcdByte(uint8_t value, bool isData)
+{
+	if ( isData )
+	{
+		if ( lcdCgram )
+			return;
+
+		int row(lcdAddr >= 0x40 ? 1 : 0);
+		int col(lcdAddr & 0x3F);
+
+		if ( col < 16 && lcdScreen[row][col] != (char) value )
+		{
+			lcdScreen[row][col] = value;
+			lcdDirty = true;
+		}
+
+		lcdAddr = (lcdAddr + 1) & 0x7F;
+		return;
+	}
+
+	if ( value & 0x80 ) // Set DDRAM address
+	{
+		lcdCgram = false;
+		lcdAddr = value & 0x7F;
+	}
+	else if ( value & 0x40 ) // Set CGRAM address
+		lcdCgram = true;
+	else if ( value == 0x01 || value == 0x02 ) // Clear or home
+	{
+		if ( value == 0x01 )
+		{
+			memset(lcdScreen[0], ' ', 16);
+			memset(lcdScreen[1], ' ', 16);
+			lcdDirty = true;
+		}
+
+		lcdCgram = false;
+		lcdAddr = 0;
+	}
+}
+
+// The LCD latches the data lines on the falling edge of enable
+void lcdLatch(void)
+{
+	uint8_t nibble(0);
+
+	for ( int i = 0; i < 4; ++i )
+		if ( Host::pinState(LCD_D4_PIN + i) )
+			nibble |= 1 << i;
+
+	if ( ! lcdFourBit )
+	{
+		// Still in 8-bit mode (initialization).  Only "function set" matters
+		if ( nibble == 0x02 )
+			lcdFourBit = true;
+
+		return;
+	}
+
+	if ( ! lcdHaveHighNibble )
+	{
+		lcdHaveHighNibble = true;
+		lcdHighNibble = nibble;
+		return;
+	}
+
+	lcdHaveHighNibble = false;
+	lcdByte((lcdHighNibble << 4) | nibble, Host::pinState(LCD_RS_PIN));
+}
+
+} // namespace
+
+namespace Host {
+
+// Called just before an output pin changes state
+void pinWritten(uint8_t pin, uint8_t val)
+{
+	switch ( pin )
+	{
+	case 4:
+	case 5:
+	case 6:
+	case 7:
+		// Relay outputs.  Account for the time spent in the previous state
+		updateOven();
+		break;
+
+	case LCD_EN_PIN:
+		if ( val == LOW )
+			lcdLatch();
+		break;
+
+	case TC_CS_PIN:
+		if ( val == LOW )
+		{
+			tcFrame = thermocoupleFrame();
+			tcBit = 31;
+		}
+		break;
+
+	case TC_CLK_PIN:
+		// The MAX31855 shifts the next bit out on the falling edge of the clock
+		if ( val == LOW && Host::pinState(TC_CS_PIN) == LOW )
+			--tcBit;
+		break;
+	}
+}
+
+int pinRead(uint8_t pin, uint8_t latched)
+{
+	if ( pin == CONTROLEO_BUTTON_TOP_PIN || pin == CONTROLEO_BUTTON_BOTTOM_PIN )
+	{
+		const uint32_t now(millis());
+
+		for ( size_t i = 0; i < buttonPresses.size(); ++i )
+		{
+			const ButtonPress &bp(buttonPresses[i]);
+
+			if ( bp.pin == pin && now >= bp.ms && now < bp.ms + bp.holdMs )
+				return LOW;
+		}
+
+		return latched;
+	}
+
+	if ( pin == TC_MISO_PIN )
+	{
+		if ( Host::pinState(TC_CS_PIN) == LOW && tcBit >= 0 )
+			return (tcFrame >> tcBit) & 0x01;
+
+		return LOW;
+	}
+
+	return latched;
+}
+
+void addButtonPress(uint32_t ms, uint8_t button, uint32_t holdMs)
+{
+	ButtonPress bp = { ms
+		, (uint8_t) (button == CONTROLEO_BUTTON_TOP ? CONTROLEO_BUTTON_TOP_PIN : CONTROLEO_BUTTON_BOTTOM_PIN)
+		, holdMs };
+
+	buttonPresses.push_back(bp);
+}
+
+void addSerialInput(uint32_t ms, const char *text)
+{
+	SerialInput si = { ms, text };
+
+	serialInputs.push_back(si);
+}
+
+int serialPeek(void)
+{
+	const uint32_t now(millis());
+
+	for ( size_t i = 0; i < serialInputs.size(); )
+	{
+		if ( serialInputs[i].ms <= now )
+		{
+			serialBuffer += serialInputs[i].text;
+			serialInputs.erase(serialInputs.begin() + i);
+		}
+		else
+			++i;
+	}
+
+	return serialBuffer.empty() ? -1 : (uint8_t) serialBuffer[0];
+}
+
+int serialRead(void)
+{
+	int c(serialPeek());
+
+	if ( c >= 0 )
+		serialBuffer.erase(0, 1);
+
+	return c;
+}
+
+OvenModel &ovenModel(void)
+{
+	return model;
+}
+
+void setOvenTemp(double t)
+{
+	temp = t;
+}
+
+double ovenTemp(void)
+{
+	updateOven();
+	return temp;
+}
+
+bool lcdChanged(void)
+{
+	bool changed(lcdDirty);
+
+	lcdDirty = false;
+	return changed;
+}
+
+void lcdLine(int line, char *buf)
+{
+	char *p(buf);
+
+	for ( int i = 0; i < 16; ++i )
+	{
+		char c(lcdScreen[line & 1][i]);
+
+		if ( c == 1 ) // The firmware puts the degree symbol in CGRAM slot 1
+		{
+			strcpy(p, "\xC2\xB0");
+			p += 2;
+		}
+		else
+			*p++ = (c >= ' ' && c < 0x7F) ? c : '?';
+	}
+
+	*p = '\0';
+}
+
+} // namespace Host
@@ -0,0 +1,180 @@
+// Host (Linux) driver for ReflowWizard
+// Runs setup() and then loop() against the emulated ControLeo2 until the
+// requested amount of virtual time has passed.
+//
+// Serial output from the firmware goes to stdout.  Everything the host adds
+// (LCD contents, summary) goes to stderr so stdout can be captured as-is.
+//
+// Example: start a bake from a fresh EEPROM, with D4 = top element, D5 = bottom
+//   ./ReflowWizardHost -s 1=1 -s 2=2 -b 4000:top -b 4300:top -b 4600:top -b 5000:bottom -t 70000 -l
+
+#include <Arduino.h>
+#include <ControLeo2.h>
+#include <unistd.h>
+#include <time.h>
+#include <vector>
+#include "ReflowWizard.h"
+#include "Host.h"
+
+namespace {
+
+#define BUTTON_HOLD_MS 100
+
+struct SettingPoke
+{
+	int settingNum;
+	int value;
+};
+
+void usage(const char *argv0)
+{
+	fprintf(stderr,
+		"Usage: %s [options]\n"
+		"  -t SECONDS     Virtual time to run for (default 600)\n"
+		"  -b MS:BUTTON   Press \"top\" or \"bottom\" at MS milliseconds after power on\n"
+		"  -i MS:TEXT     Send TEXT to the serial port at MS milliseconds\n"
+		"  -s NUM=VALUE   Settings::set(NUM, VALUE) once setup() has finished\n"
+		"  -e FILE        EEPROM image, loaded at power on and saved on exit\n"
+		"  -l             Show the LCD on stderr whenever it changes\n"
+		"  -T TEMP        Starting oven temp (C, default ambient)\n"
+		"  -a TEMP        Ambient temp (C, default 25)\n"
+		"  -k SECONDS     Oven heat loss time constant (default 400)\n"
+		"  -g SECONDS     Element warm-up time constant (default 25)\n"
+		"  -n TEMP        Peak thermocouple noise (C, default 0)\n"
+		, argv0);
+}
+
+void showLcd(void)
+{
+	char line0[33];
+	char line1[33];
+
+	Host::lcdLine(0, line0);
+	Host::lcdLine(1, line1);
+
+	fprintf(stderr, "[%9.3f] |%s|%s|\n", Host::nowNs() / 1e9, line0, line1);
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+	double seconds(600.0);
+	const char *eepromPath(NULL);
+	bool lcdTrace(false);
+	double startTemp(-1000.0);
+	std::vector<SettingPoke> pokes;
+	Host::OvenModel &model(Host::ovenModel());
+	int opt;
+
+	while ( (opt = getopt(argc, argv, "t:b:i:s:e:lT:a:k:g:n:h")) != -1 )
+	{
+		char *end(NULL);
+
+		switch ( opt )
+		{
+		case 't':
+			seconds = atof(optarg);
+			break;
+
+		case 'b':
+		{
+			uint32_t ms(strtoul(optarg, &end, 10));
+
+			if ( *end != ':' || (strcmp(end + 1, "top") && strcmp(end + 1, "bottom")) )
+			{
+				usage(argv[0]);
+				return 1;
+			}
+
+			Host::addButtonPress(ms
+				, strcmp(end + 1, "top") ? CONTROLEO_BUTTON_BOTTOM : CONTROLEO_BUTTON_TOP
+				, BUTTON_HOLD_MS);
+			break;
+		}
+
+		case 'i':
+		{
+			uint32_t ms(strtoul(optarg, &end, 10));
+
+			if ( *end != ':' )
+			{
+				usage(argv[0]);
+				return 1;
+			}
+
+			Host::addSerialInput(ms, end + 1);
+			break;
+		}
+
+		case 's':
+		{
+			SettingPoke poke;
+
+			poke.settingNum = strtol(optarg, &end, 10);
+
+			if ( *end != '=' )
+			{
+				usage(argv[0]);
+				return 1;
+			}
+
+			poke.value = strtol(end + 1, NULL, 10);
+			pokes.push_back(poke);
+			break;
+		}
+
+		case 'e': eepromPath = optarg; break;
+		case 'l': lcdTrace = true; break;
+		case 'T': startTemp = atof(optarg); break;
+		case 'a': model.ambient = atof(optarg); break;
+		case 'k': model.tau = atof(optarg); break;
+		case 'g': model.lag = atof(optarg); break;
+		case 'n': model.noise = atof(optarg); break;
+
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? 0 : 1;
+		}
+	}
+
+	if ( ! eepromPath || ! Host::loadEeprom(eepromPath) )
+		Host::eraseEeprom();
+
+	Host::setOvenTemp(startTemp > -273.0 ? startTemp : model.ambient);
+
+	const clock_t wallStart(clock());
+	const uint64_t endNs((uint64_t) (seconds * 1e9));
+
+	setup();
+
+	for ( size_t i = 0; i < pokes.size(); ++i )
+		Settings::set(pokes[i].settingNum, pokes[i].value);
+
+	while ( Host::nowNs() < endNs )
+	{
+		const uint64_t before(Host::nowNs());
+
+		loop();
+
+		// Make sure time moves even if loop() never waits
+		if ( Host::nowNs() == before )
+			Host::advanceUs(1000);
+
+		if ( lcdTrace && Host::lcdChanged() )
+			showLcd();
+	}
+
+	fflush(stdout);
+
+	if ( eepromPath && ! Host::saveEeprom(eepromPath) )
+		fprintf(stderr, "Unable to save EEPROM image to %s\n", eepromPath);
+
+	fprintf(stderr, "Simulated %.1fs in %.2fs.  Oven at %.2fC.  %u EEPROM writes\n"
+		, Host::nowNs() / 1e9
+		, (double) (clock() - wallStart) / CLOCKS_PER_SEC
+		, Host::ovenTemp()
+		, Host::eepromWrites());
+
+	return 0;
+}
@@ -0,0 +1,45 @@
+#pragma once
+// Host (Linux) version of the Arduino Print class
+// Same interface and number formatting as the Arduino core
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+class __FlashStringHelper;
+
+class Print
+{
+public:
+	virtual ~Print() {}
+
+	virtual size_t write(uint8_t) = 0;
+	virtual size_t write(const uint8_t *buffer, size_t size);
+	size_t write(const char *str) { return str ? write((const uint8_t *)str, strlen(str)) : 0; }
+	size_t write(const char *buffer, size_t size) { return write((const uint8_t *)buffer, size); }
+
+	size_t print(const __FlashStringHelper *);
+	size_t print(const char[]);
+	size_t print(char);
+	size_t print(unsigned char, int = 10);
+	size_t print(int, int = 10);
+	size_t print(unsigned int, int = 10);
+	size_t print(long, int = 10);
+	size_t print(unsigned long, int = 10);
+	size_t print(double, int = 2);
+
+	size_t println(const __FlashStringHelper *);
+	size_t println(const char[]);
+	size_t println(char);
+	size_t println(unsigned char, int = 10);
+	size_t println(int, int = 10);
+	size_t println(unsigned int, int = 10);
+	size_t println(long, int = 10);
+	size_t println(unsigned long, int = 10);
+	size_t println(double, int = 2);
+	size_t println(void);
+
+private:
+	size_t printNumber(unsigned long, uint8_t);
+	size_t printFloat(double, uint8_t);
+};
@@ -0,0 +1,5 @@
+#pragma once
+// Host (Linux) version of avr/eeprom.h
+// Only what the sketch uses.  The EEPROM itself is in HostCore.cpp.
+
+bool eeprom_is_ready(void); // False while a write is still in progress
@@ -0,0 +1,12 @@
+#pragma once
+// Host (Linux) version of avr/interrupt.h
+// Interrupt handlers are plain functions called by the virtual clock
+
+#define ISR(vector) void vector(void)
+
+void TIMER0_COMPA_vect(void);
+void TIMER1_COMPA_vect(void);
+void TIMER1_COMPB_vect(void);
+
+void cli(void);
+void sei(void);
@@ -0,0 +1,35 @@
+#pragma once
+// Host (Linux) version of the ATmega32U4 registers used by ReflowWizard
+// Timer 1 and Timer 0 Compare A are emulated.  Their interrupts are fired by the virtual clock.
+
+#include <stdint.h>
+
+#define _BV(bit) (1 << (bit))
+
+// TCCR1B
+#define CS10  0
+#define CS11  1
+#define CS12  2
+#define WGM12 3
+#define WGM13 4
+
+// TIMSK0
+#define TOIE0  0
+#define OCIE0A 1
+#define OCIE0B 2
+
+// TIMSK1
+#define TOIE1  0
+#define OCIE1A 1
+#define OCIE1B 2
+#define OCIE1C 3
+
+extern volatile uint8_t OCR0A;
+extern volatile uint8_t TIMSK0;
+
+extern volatile uint8_t TCCR1A;
+extern volatile uint8_t TCCR1B;
+extern volatile uint16_t TCNT1;
+extern volatile uint16_t OCR1A;
+extern volatile uint16_t OCR1B;
+extern volatile uint8_t TIMSK1;
@@ -0,0 +1,27 @@
+#pragma once
+// Host (Linux) version of avr/pgmspace.h
+// There is only one address space on the host, so flash accesses are plain reads
+
+#include <stdint.h>
+#include <string.h>
+
+#define PROGMEM
+#define PSTR(s) (s)
+#define F(s) (reinterpret_cast<const __FlashStringHelper *>(PSTR(s)))
+
+#define pgm_read_byte(addr)      (*(const uint8_t *)(addr))
+#define pgm_read_byte_near(addr) pgm_read_byte(addr)
+#define pgm_read_word(addr)      (*(const uint16_t *)(addr))
+#define pgm_read_word_near(addr) pgm_read_word(addr)
+#define pgm_read_dword(addr)     (*(const uint32_t *)(addr))
+#define pgm_read_ptr(addr)       (*(void * const *)(addr))
+
+#define strlen_P   strlen
+#define strcpy_P   strcpy
+#define strncpy_P  strncpy
+#define strcat_P   strcat
+#define strcmp_P   strcmp
+#define memcpy_P   memcpy
+#define snprintf_P snprintf
+
+class __FlashStringHelper;
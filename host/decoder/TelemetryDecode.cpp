@@ -0,0 +1,153 @@
+// Decoder for ReflowWizard's binary telemetry (see TelemetryFormat.h)
+// Reads the serial port output (a capture file, or the host build's stdout) on stdin
+// and writes the samples as CSV to stdout.  Phase and duty cycle frames are written
+// as comment lines starting with '#'.  Text between the frames goes to stderr.
+//
+// Example:
+//   ./ReflowWizardHost -s 1=1 -s 2=2 -i 7000:b -b 8000:top -b 9000:top -b 10000:bottom | ./TelemetryDecode > reflow.csv
+
+#include <stdio.h>
+#include <stdint.h>
+#include <vector>
+#include "TelemetryFormat.h"
+
+namespace {
+
+const char *const sourceNames[] = {"?", "reflow", "bake", "autotune"};
+
+unsigned frames;
+unsigned badFrames; // Started with SYNC and had a sane length, but the CRC was wrong
+unsigned lostFrames;
+int lastSequence(-1);
+
+int get8(const uint8_t *p)
+{
+	return p[0];
+}
+
+int get16(const uint8_t *p)
+{
+	return (int16_t) (p[0] | (p[1] << 8));
+}
+
+unsigned getU16(const uint8_t *p)
+{
+	return p[0] | (p[1] << 8);
+}
+
+uint32_t get32(const uint8_t *p)
+{
+	return getU16(p) | ((uint32_t) getU16(p + 2) << 16);
+}
+
+void decode(const uint8_t *payload, int length)
+{
+	const int sequence(payload[1]);
+
+	if ( lastSequence >= 0 )
+		lostFrames += (sequence - lastSequence - 1) & 0xFF;
+
+	lastSequence = sequence;
+	++frames;
+
+	switch ( payload[0] )
+	{
+	case TELEMETRY_SAMPLE:
+	{
+		if ( length < TELEMETRY_SAMPLE_LENGTH )
+			break;
+
+		const int source(get8(payload + SAMPLE_SOURCE));
+		const int temp(get16(payload + SAMPLE_TEMP));
+		const int outputs(get8(payload + SAMPLE_OUTPUTS));
+
+		printf("%u,%.3f,%s,%d,%.2f,%d,%d,%d,%d,%d,%d,%d,%d,%u,%d,%d,%d\n"
+			, sequence
+			, get32(payload + SAMPLE_TIME) / 1000.0
+			, sourceNames[source <= TELEMETRY_AUTOTUNE ? source : 0]
+			, get8(payload + SAMPLE_PHASE)
+			, temp / 4.0
+			, outputs & 1, (outputs >> 1) & 1, (outputs >> 2) & 1, (outputs >> 3) & 1
+			, get8(payload + SAMPLE_DUTY), get8(payload + SAMPLE_DUTY + 1)
+			, get8(payload + SAMPLE_DUTY + 2), get8(payload + SAMPLE_DUTY + 3)
+			, getU16(payload + SAMPLE_SECONDS)
+			, get16(payload + SAMPLE_TERM), get16(payload + SAMPLE_TERM + 2)
+			, get16(payload + SAMPLE_TERM + 4));
+		break;
+	}
+
+	case TELEMETRY_PHASE:
+		if ( length < TELEMETRY_PHASE_LENGTH )
+			break;
+
+		printf("# phase %d: end temp %dC, duration %d-%ds, duty %d %d %d %d\n"
+			, get8(payload + 2), get16(payload + 3), get16(payload + 5), get16(payload + 7)
+			, get8(payload + 9), get8(payload + 10), get8(payload + 11), get8(payload + 12));
+		break;
+
+	case TELEMETRY_DUTY:
+		if ( length < TELEMETRY_DUTY_LENGTH )
+			break;
+
+		printf("# phase %d: D%d duty changed from %d to %d\n"
+			, get8(payload + 2), get8(payload + 3) + 4, get8(payload + 4), get8(payload + 5));
+		break;
+
+	default:
+		printf("# unknown frame type %d\n", payload[0]);
+		break;
+	}
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+	if ( argc > 1 )
+	{
+		fprintf(stderr, "Usage: %s < serial-capture > samples.csv\n", argv[0]);
+		return 1;
+	}
+
+	std::vector<uint8_t> in;
+	int c;
+
+	while ( (c = getchar()) != EOF )
+		in.push_back(c);
+
+	printf("sequence,time,source,phase,temp,d4,d5,d6,d7,duty4,duty5,duty6,duty7,seconds,term0,term1,term2\n");
+
+	size_t i(0);
+
+	while ( i < in.size() )
+	{
+		// Is there a frame here?  Anything else is text
+		if ( in[i] == TELEMETRY_SYNC && i + 1 < in.size() )
+		{
+			const int length(in[i + 1]);
+
+			if ( length >= 2 && length <= TELEMETRY_MAX_PAYLOAD && i + length + 4 <= in.size() )
+			{
+				uint16_t crc(0xFFFF);
+
+				for ( int j = 0; j < length + 1; ++j )
+					crc = telemetryCrc(crc, in[i + 1 + j]);
+
+				if ( crc == (in[i + length + 2] | (in[i + length + 3] << 8)) )
+				{
+					decode(&in[i + 2], length);
+					i += length + 4;
+					continue;
+				}
+
+				++badFrames;
+			}
+		}
+
+		fputc(in[i++], stderr);
+	}
+
+	fprintf(stderr, "%u frames, %u lost, %u with a bad CRC\n", frames, lostFrames, badFrames);
+
+	return 0;
+}
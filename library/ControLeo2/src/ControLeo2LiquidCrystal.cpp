@@ -11,11 +11,15 @@
 //
 // Change History:
 // 14 August 2014        Initial Version
+// 16 October 2026       Shadow framebuffer, only changed characters are sent
+// 16 October 2026       Asynchronous mode, bytes are sent from the Timer 0 interrupt
 
 #include <stdio.h>
 #include <string.h>
 #include <inttypes.h>
 #include <Arduino.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
 #include "ControLeo2LiquidCrystal.h"
 
 // Commands
@@ -54,6 +58,23 @@
 #define FLG_2LINE 0x08
 #define FLG_1LINE 0x00
 
+#define NO_ADDR 0xFF // The LCD's address counter is unknown
+
+// Asynchronous mode
+// Timer 0 runs millis() and overflows every 1.024ms.  Its Compare A interrupt isn't used
+// by the Arduino core, so it is used to send one byte per overflow period, which is much
+// longer than the 37us an HD44780 needs.  OCR0A is set half way between overflows.
+// The interrupt is only enabled while there is something to send.
+// Note: analogWrite() on D11 also uses OCR0A, but D11 is the top button on ControLeo2.
+#define QUEUE_CHAR 0x100 // Queue entry is a character (RS high)
+#define TIMER0_COMPARE 128
+
+namespace {
+
+ControLeo2::LiquidCrystal *asyncLcd; // The LCD being driven by the interrupt
+
+} // namespace
+
 namespace ControLeo2 {
 
 // When the display powers up, it is configured as follows:
@@ -77,8 +98,19 @@ namespace ControLeo2 {
 
 
 LiquidCrystal::LiquidCrystal()
+	: _shadowOn(false)
+	, _cgram(false)
+	, _addr(0)
+	, _lcdAddr(NO_ADDR)
+	, _bytesSent(0)
+	, _bytesSkipped(0)
+	, _async(false)
+	, _qHead(0)
+	, _qTail(0)
+	, _holdTicks(0)
 {
 	_dspFunc = FLG_4BITMODE | FLG_1LINE | CHARSIZE_5x8DOTS;
+	_dspMode = FLG_ENTRYLEFT | FLG_ENTRYSHIFTDECREMENT;
 
 	// Save the pins used to drive the LCD
 	_rsPin = A0;
@@ -98,11 +130,16 @@ LiquidCrystal::LiquidCrystal()
 
 void LiquidCrystal::begin(uint8_t cols, uint8_t lines, uint8_t dotsize)
 {
+	// The initialization needs exact delays, so do it synchronously
+	const bool wasAsync(_async);
+	setAsync(false);
+
 	if ( lines > 1 )
         _dspFunc |= FLG_2LINE;
 
 	_lineCount = lines;
 	_curLine = 0;
+	_cols = cols;
 
 	// For some 1 line displays you can select a 10 pixel high font
 	if ( (dotsize != 0) && (lines == 1) )
@@ -148,19 +185,31 @@ void LiquidCrystal::begin(uint8_t cols, uint8_t lines, uint8_t dotsize)
 	_dspMode = FLG_ENTRYLEFT | FLG_ENTRYSHIFTDECREMENT;
 	// Set the entry mode
 	command(CMD_ENTRYMODESET | _dspMode);
+
+	setAsync(wasAsync);
 }
 
 void LiquidCrystal::clear(void)
 {
 	command(CMD_CLEARDISPLAY); // Clear display, set cursor position to zero
-	delayMicroseconds(2000);   // This command takes a long time!
+
+	if ( ! _async )              // (The interrupt waits when asynchronous)
+		delayMicroseconds(2000); // This command takes a long time!
+
+	// The display is now known to be blank, so the shadow can be (re)started.
+	// The shadow assumes text flows left to right without autoscroll.
+	_shadowOn = _lineCount <= SHADOW_ROWS && _cols <= SHADOW_COLS
+				&& _dspMode == (FLG_ENTRYLEFT | FLG_ENTRYSHIFTDECREMENT);
+	memset(_shadow, ' ', sizeof(_shadow));
 }
 
 // Set the cursor position to (0, 0)
 void LiquidCrystal::home(void)
 {
 	command(CMD_RETURNHOME); // Set cursor position to zero
-	delayMicroseconds(2000); // This command takes a long time!
+
+	if ( ! _async )
+		delayMicroseconds(2000); // This command takes a long time!
 }
 
 // Put the cursor in the specified position
@@ -171,6 +220,14 @@ void LiquidCrystal::setCursor(uint8_t col, uint8_t row)
 	if ( row > _lineCount )
 		row = _lineCount - 1;    // Count rows starting with 0
 
+	if ( _shadowOn )
+	{
+		// Don't move the LCD's cursor until a character actually needs to be sent
+		_addr = col + row_offsets[row];
+		_cgram = false;
+		return;
+	}
+
 	command(CMD_SETDDRAMADDR | (col + row_offsets[row]));
 }
 
@@ -232,16 +289,20 @@ void LiquidCrystal::leftToRight(void)
 }
 
 // This is for text that flows Right to Left
+// The shadow is turned off until the next clear()
 void LiquidCrystal::rightToLeft(void)
 {
 	_dspMode &= ~FLG_ENTRYLEFT;
+	_shadowOn = false;
 	command(CMD_ENTRYMODESET | _dspMode);
 }
 
 // This will 'right justify' text from the cursor
+// The shadow is turned off until the next clear()
 void LiquidCrystal::autoscroll(void)
 {
 	_dspMode |= FLG_ENTRYSHIFTINCREMENT;
+	_shadowOn = false;
 	command(CMD_ENTRYMODESET | _dspMode);
 }
 
@@ -265,14 +326,153 @@ void LiquidCrystal::createChar(uint8_t location, uint8_t charmap[])
 
 size_t LiquidCrystal::write(uint8_t value)
 {
+	if ( ! _shadowOn || _cgram )
+	{
+		send(value, HIGH);
+		return 1;
+	}
+
+	const uint8_t row(_addr >= 0x40 ? 1 : 0);
+	const uint8_t col(_addr & 0x3F);
+
+	if ( col < SHADOW_COLS )
+	{
+		// Is this character already on the display?
+		if ( _shadow[row][col] == value )
+		{
+			_addr = nextAddr(_addr);
+			++_bytesSkipped;
+			return 1;
+		}
+
+		_shadow[row][col] = value;
+	}
+
+	// Move the LCD's cursor, unless it is already in the right place
+	if ( _lcdAddr != _addr )
+		command(CMD_SETDDRAMADDR | _addr);
+
 	send(value, HIGH);
+	_addr = nextAddr(_addr);
+	_lcdAddr = _addr;
+
 	return 1;
 }
 
+// Send a command, keeping track of where the LCD's address counter is
+void LiquidCrystal::command(uint8_t value)
+{
+	send(value, LOW);
+
+	if ( value & CMD_SETDDRAMADDR )
+	{
+		_addr = _lcdAddr = value & 0x7F;
+		_cgram = false;
+	}
+	else if ( value & CMD_SETCGRAMADDR )
+	{
+		_cgram = true;
+		_lcdAddr = NO_ADDR;
+	}
+	else if ( (value & 0xF0) == CMD_CURSORSHIFT )
+	{
+		if ( ! (value & FLG_DISPLAYMOVE) ) // The cursor moved
+			_lcdAddr = NO_ADDR;
+	}
+	else if ( value == CMD_CLEARDISPLAY || (value & 0xFE) == CMD_RETURNHOME )
+	{
+		_addr = _lcdAddr = 0;
+		_cgram = false;
+	}
+}
+
+// The display RAM address after addr, following the LCD's own wrapping
+uint8_t LiquidCrystal::nextAddr(uint8_t addr) const
+{
+	if ( _lineCount > 1 )
+	{
+		if ( addr == 0x27 )
+			return 0x40;
+
+		if ( addr == 0x67 )
+			return 0x00;
+	}
+	else if ( addr == 0x4F )
+		return 0x00;
+
+	return addr + 1;
+}
+
+void LiquidCrystal::setAsync(bool async)
+{
+	if ( ! async )
+		flush();
+
+	if ( async && ! _async )
+	{
+		asyncLcd = this;
+		OCR0A = TIMER0_COMPARE;
+	}
+
+	_async = async;
+}
+
+void LiquidCrystal::flush(void)
+{
+	while ( _qTail != _qHead || _holdTicks )
+		delayMicroseconds(100);
+}
+
+// Timer 0 Compare A interrupt, every 1.024ms while there is something to send
+bool LiquidCrystal::tick(void)
+{
+	// Is a clear or home command still running?
+	if ( _holdTicks )
+	{
+		--_holdTicks;
+		return true;
+	}
+
+	if ( _qTail == _qHead )
+		return false;
+
+	const uint16_t entry(_queue[_qTail]);
+
+	digitalWrite(_rsPin, (entry & QUEUE_CHAR) ? HIGH : LOW);
+	out4Bits(entry >> 4);
+	out4Bits(entry);
+	_qTail = (_qTail + 1) & (QUEUE_SIZE - 1);
+
+	// Clear and home take 1.52ms, so skip the next tick
+	if ( ! (entry & (QUEUE_CHAR | 0xFC)) )
+		_holdTicks = 1;
+
+	return true;
+}
+
 // Low level data pushing commands
 // Write either command or data, with automatic 4/8-bit selection
 void LiquidCrystal::send(uint8_t value, uint8_t mode)
 {
+	++_bytesSent;
+
+	if ( _async )
+	{
+		const uint8_t next((_qHead + 1) & (QUEUE_SIZE - 1));
+
+		// Wait for the interrupt to make room
+		while ( next == _qTail )
+			delayMicroseconds(100);
+
+		_queue[_qHead] = mode == HIGH ? (value | QUEUE_CHAR) : value;
+		_qHead = next;
+
+		// (The interrupt may disable itself between the read and the write here.
+		// It is then enabled again, which is what is wanted.)
+		TIMSK0 |= _BV(OCIE0A);
+		return;
+	}
+
 	digitalWrite(_rsPin, mode);
 
 	wr4Bits(value>>4);
@@ -280,6 +480,13 @@ void LiquidCrystal::send(uint8_t value, uint8_t mode)
 }
 
 void LiquidCrystal::wr4Bits(uint8_t value)
+{
+	out4Bits(value);
+	delayMicroseconds(100);   // commands need > 37us to settle
+}
+
+// Put a nibble on the data pins and pulse enable
+void LiquidCrystal::out4Bits(uint8_t value)
 {
 	for ( int i = 0; i < 4; ++i )
 		digitalWrite(_dataPins[i], (value >> i) & 0x01);
@@ -290,8 +497,27 @@ void LiquidCrystal::wr4Bits(uint8_t value)
 	digitalWrite(_enPin, HIGH);
 	delayMicroseconds(1);    // enable pulse must be >450ns
 	digitalWrite(_enPin, LOW);
-	delayMicroseconds(100);   // commands need > 37us to settle
 }
 
 } // namespace ControLeo2
 
+// Clocking out a byte with digitalWrite takes about 50us, which would stretch a servo pulse
+// (lowered by Timer 1 Compare B) that ends meanwhile.  So interrupts are enabled again while
+// the byte is sent, with this one masked so it can't run inside itself.  It is only unmasked
+// again if there is more to send.  (send() can't run until this returns.)
+ISR(TIMER0_COMPA_vect)
+{
+	if ( ! asyncLcd )
+		return;
+
+	TIMSK0 &= ~_BV(OCIE0A);
+	sei();
+
+	const bool more(asyncLcd->tick());
+
+	cli();
+
+	if ( more )
+		TIMSK0 |= _BV(OCIE0A);
+}
+
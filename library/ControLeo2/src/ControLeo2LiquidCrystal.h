@@ -5,6 +5,8 @@
 //
 // Change History:
 // 14 August 2014        Initial Version
+// 16 October 2026       Shadow framebuffer, only changed characters are sent
+// 16 October 2026       Asynchronous mode, bytes are sent from the Timer 0 interrupt
 
 #include <Arduino.h>
 #include <Print.h>
@@ -22,6 +24,15 @@ public:
 		, CHARSIZE_5x10DOTS = 0x04
 	};
 
+	// Size of the shadow copy of the display (ControLeo2 has a 16x2 LCD)
+	enum {
+		SHADOW_COLS = 16
+		, SHADOW_ROWS = 2
+	};
+
+	// Bytes that can be waiting to be sent in asynchronous mode (a power of 2)
+	enum { QUEUE_SIZE = 32 };
+
 	void begin(uint8_t cols, uint8_t rows, uint8_t charsize = CHARSIZE_5x8DOTS);
 	void clear(void);
 	void home(void);
@@ -42,11 +53,25 @@ public:
 	void createChar(uint8_t, uint8_t[]);
 
 	virtual size_t write(uint8_t value);
-	void command(uint8_t value) { send(value, LOW); }
+	void command(uint8_t value);
+
+	// Asynchronous mode: commands and characters are queued and sent from the Timer 0
+	// Compare A interrupt, one byte every 1.024ms, so print() returns immediately.
+	// print() only waits if the queue is full.  Call after begin().
+	void setAsync(bool async);
+	void flush(void); // Wait until everything in the queue has been sent
+	bool tick(void);  // Called from the interrupt.  False when there is nothing left to send
+
+	// Bytes (commands and characters) sent to the LCD, and characters
+	// that didn't need to be sent because they were already on the display
+	uint32_t bytesSent(void) const { return _bytesSent; }
+	uint32_t bytesSkipped(void) const { return _bytesSkipped; }
 
 private:
 	void send(uint8_t, uint8_t);
 	void wr4Bits(uint8_t);
+	void out4Bits(uint8_t);
+	uint8_t nextAddr(uint8_t addr) const;
 
 	uint8_t _rsPin; // LOW: command.  HIGH: character.
 	uint8_t _enPin; // Activated by a HIGH pulse.
@@ -56,6 +81,25 @@ private:
 	uint8_t _dspMode;
 	uint8_t _lineCount;
 	uint8_t _curLine;
+	uint8_t _cols;
+
+	// Shadow of the display RAM.  Characters are only sent if they differ from
+	// the shadow, and the cursor is only moved when a character is sent.
+	bool _shadowOn;   // Is the shadow in sync with the display?
+	bool _cgram;      // Characters are going to CGRAM (createChar), not the display
+	uint8_t _addr;    // Display RAM address for the next character
+	uint8_t _lcdAddr; // The LCD's address counter (NO_ADDR if unknown)
+	uint8_t _shadow[SHADOW_ROWS][SHADOW_COLS];
+	uint32_t _bytesSent;
+	uint32_t _bytesSkipped;
+
+	// Asynchronous transmit queue.  The main loop adds at _qHead, the interrupt
+	// takes from _qTail.  Each entry is a byte, plus QUEUE_CHAR for characters.
+	bool _async;
+	volatile uint8_t _qHead;
+	volatile uint8_t _qTail;
+	volatile uint8_t _holdTicks; // Ticks to wait for a slow command (clear/home) to finish
+	volatile uint16_t _queue[QUEUE_SIZE];
 };
 
 } // namespace ControLeo2
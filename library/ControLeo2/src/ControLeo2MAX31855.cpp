@@ -6,6 +6,13 @@ const int MISO_PIN(8);
 const int CS_PIN(9);
 const int CLK_PIN(10);
 
+#if MAX31855_FAST_READ
+// The same pins, as bits in port B of the ATmega32U4 (D8 = PB4, D9 = PB5, D10 = PB6)
+#define MISO_BIT PINB4
+#define CS_BIT   PORTB5
+#define CLK_BIT  PORTB6
+#endif
+
 } // namespace
 
 namespace ControLeo2 {
@@ -39,44 +46,43 @@ MAX31855::MAX31855()
  */
 bool MAX31855::readThermocouple(double &target, bool wantFahrenheit)
 {
-	_fault = 0;
 	target = 9999.9;
 
+	int16_t quarters;
+
+	if ( ! readQuarterDegrees(quarters) )
+		return false;
+
+	// Convert to Degree Celsius
+	target = quarters * 0.25;
+
+	if ( wantFahrenheit )
+	{
+		// Convert Degree Celsius to Fahrenheit
+		target = (target * 9.0/5.0)+ 32;
+	}
+
+	return true;
+}
+
+/*
+ * Read the thermocouple temp in quarters of a degree Celsius.
+ * This is the 14-bit signed value from the MAX31855, so no conversion is needed.
+ */
+bool MAX31855::readQuarterDegrees(int16_t &target)
+{
+	_fault = 0;
+
 	uint32_t data(getRawData());
-	//double temp(0.0);
 
 	if ( ! (data & 0x00010000) ) // no fault detected
 	{
-		// Retrieve thermocouple temp data and strip redundant data
-		data = data >> 18;
-		// Bit-14 is the sign
-		target = (data & 0x00001FFF);
-
-		// Check for negative temp
-		if ( data & 0x00002000 )
-		{
-			// 2's complement operation
-			// Invert
-			data = ~data;
-			// Ensure operation involves lower 13-bit only
-			target = data & 0x00001FFF;
-			// Add 1 to obtain the positive number
-			target += 1;
-			// Make temp negative
-			target *= -1;
-		}
-
-		// Convert to Degree Celsius
-		target *= 0.25;
-
-		if ( wantFahrenheit )
-		{
-			// Convert Degree Celsius to Fahrenheit
-			target = (target * 9.0/5.0)+ 32;
-		}
-
+		// The temp is in the top 14 bits (bit 31 is the sign).  Shifting the top
+		// 16 bits right by 2 keeps the sign.
+		target = (int16_t) (data >> 16) >> 2;
 		return true;
 	}
+
 	// Check for fault type (3 LSB)
 	switch ( data & 0x00000007 )
 	{
@@ -128,6 +134,32 @@ void MAX31855::readJunction(double &target, bool wantFahrenheit)
  * Minimum clock pulse width is 100 ns.
  * No delay is required in this case.
  */
+#if MAX31855_FAST_READ
+// Each port access is a single sbi/cbi/in instruction (125ns), which still meets
+// the 100ns minimum clock pulse width.  The whole read takes about 10us.
+uint32_t MAX31855::getRawData(void)
+{
+	uint32_t data(0);
+
+	PORTB &= ~_BV(CS_BIT);
+
+	// Shift in 32-bit of data, most significant bit first
+	for ( uint8_t bitCount = 0; bitCount < 32; ++bitCount )
+	{
+		PORTB |= _BV(CLK_BIT);
+		data <<= 1;
+
+		if ( PINB & _BV(MISO_BIT) ) // data bit is high
+			data |= 1;
+
+		PORTB &= ~_BV(CLK_BIT);
+	}
+
+	PORTB |= _BV(CS_BIT);
+
+	return data;
+}
+#else
 uint32_t MAX31855::getRawData(void)
 {
 	uint32_t data(0);
@@ -149,6 +181,7 @@ uint32_t MAX31855::getRawData(void)
 
 	return data;
 }
+#endif
 
 } // namespace ControLeo2
 
@@ -4,9 +4,24 @@
 //
 // Change History:
 // 14 August 2014        Initial Version
+// 16 October 2026       Read the MAX31855 through the port registers on the ATmega32U4
+// 16 October 2026       Integer (quarter degree) thermocouple reading
 
 #include <Arduino.h>
 
+// On ControLeo2 (ATmega32U4) the MAX31855 is read by writing the port registers directly.
+// A reading takes a few microseconds, instead of around 400us using digitalWrite/digitalRead.
+// Other boards (and the host build) always use digitalWrite/digitalRead.
+// To use digitalWrite/digitalRead on ControLeo2 as well, uncomment this line
+// (or define it on the compiler command line):
+//#define MAX31855_USE_DIGITALWRITE
+
+#if defined(__AVR_ATmega32U4__) && ! defined(MAX31855_USE_DIGITALWRITE)
+#define MAX31855_FAST_READ 1
+#else
+#define MAX31855_FAST_READ 0
+#endif
+
 namespace ControLeo2 {
 
 class MAX31855
@@ -24,6 +39,8 @@ public:
 
 	/* returns false for thermocouple fault */
 	bool readThermocouple(double &target, bool wantFahrenheit = false);
+	/* Same, in quarters of a degree Celsius (the MAX31855's resolution).  No floating point */
+	bool readQuarterDegrees(int16_t &target);
 	bool isFaultOpen(void) const { return _fault == 1; }
 	bool isFaultShortGnd(void) const { return _fault == 2; }
 	bool isFaultShortVcc(void) const { return _fault == 3; }